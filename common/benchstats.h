@@ -0,0 +1,92 @@
+#ifndef _BENCHSTATS_H
+#define _BENCHSTATS_H
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+/*
+ * Summary statistics of a set of timing samples.  The minimum is what
+ * the test harness compares; the median and the confidence interval of
+ * the mean tell whether a difference between two runs is larger than
+ * the noise of the machine.
+ */
+struct SampleStats {
+    int n;
+    double min;
+    double max;
+    double mean;
+    double median;
+    // sample standard deviation (n - 1 in the denominator)
+    double stddev;
+    double p95;
+    // half-width of the 95% confidence interval of the mean, from the
+    // Student t distribution (0 with fewer than two samples)
+    double ci95;
+
+    SampleStats()
+      : n(0), min(0), max(0), mean(0), median(0), stddev(0), p95(0), ci95(0) {}
+};
+
+/*
+ * Returns the p-th percentile (0 <= p <= 1) of sorted `samples`,
+ * interpolating linearly between the two closest ranks.
+ */
+inline double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    double rank = p * (sorted.size() - 1);
+    size_t lo = (size_t)rank;
+    size_t hi = std::min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (rank - lo) * (sorted[hi] - sorted[lo]);
+}
+
+/*
+ * Two-sided 95% critical value of the Student t distribution with
+ * `df` degrees of freedom.
+ */
+inline double tCritical95(int df) {
+    static const double table[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+    const int table_size = sizeof(table) / sizeof(table[0]);
+    if (df < 1) {
+        return 0;
+    }
+    if (df <= table_size) {
+        return table[df - 1];
+    }
+    return df <= 60 ? 2.000 : (df <= 120 ? 1.980 : 1.960);
+}
+
+inline SampleStats summarize(std::vector<double> samples) {
+    SampleStats stats;
+    stats.n = (int)samples.size();
+    if (samples.empty()) {
+        return stats;
+    }
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double x : samples) {
+        sum += x;
+    }
+    stats.min = samples.front();
+    stats.max = samples.back();
+    stats.mean = sum / stats.n;
+    stats.median = percentile(samples, 0.5);
+    stats.p95 = percentile(samples, 0.95);
+    if (stats.n > 1) {
+        double squares = 0;
+        for (double x : samples) {
+            squares += (x - stats.mean) * (x - stats.mean);
+        }
+        stats.stddev = sqrt(squares / (stats.n - 1));
+        stats.ci95 = tCritical95(stats.n - 1) * stats.stddev / sqrt((double)stats.n);
+    }
+    return stats;
+}
+
+#endif
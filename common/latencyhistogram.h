@@ -0,0 +1,165 @@
+#ifndef _LATENCYHISTOGRAM_H
+#define _LATENCYHISTOGRAM_H
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+/*
+ * LatencyHistogram: a log-linear histogram of non-negative integer
+ * values (nanoseconds here), laid out like an HdrHistogram with two
+ * significant digits.  Every power-of-two range of values is split into
+ * 64 equal sub-buckets, so a recorded value is kept with a relative error
+ * below 1/64 whatever its magnitude, recording is a few shifts and an
+ * increment, and percentiles far into the tail stay accurate without
+ * storing the samples.
+ */
+class LatencyHistogram {
+    public:
+        LatencyHistogram()
+          : counts_(bucketIndex(~0ULL >> 1) + 1, 0), total_(0), min_(0), max_(0), sum_(0), sum_squares_(0) {}
+
+        void record(long long value) {
+            if (value < 0) {
+                value = 0;
+            }
+            counts_[bucketIndex((unsigned long long)value)]++;
+            min_ = total_ == 0 ? value : std::min(min_, value);
+            max_ = std::max(max_, value);
+            sum_ += (double)value;
+            sum_squares_ += (double)value * value;
+            total_++;
+        }
+
+        long long count() const {
+            return total_;
+        }
+
+        long long min() const {
+            return min_;
+        }
+
+        long long max() const {
+            return max_;
+        }
+
+        double mean() const {
+            return total_ > 0 ? sum_ / total_ : 0;
+        }
+
+        double stddev() const {
+            if (total_ == 0) {
+                return 0;
+            }
+            double m = mean();
+            return sqrt(std::max(0.0, sum_squares_ / total_ - m * m));
+        }
+
+        /*
+          Returns the smallest value that at least `percentile` percent
+          (0..100) of the recorded values are equivalent to or below,
+          reported as the highest value of its sub-bucket.
+         */
+        long long valueAtPercentile(double percentile) const {
+            if (total_ == 0) {
+                return 0;
+            }
+            long long rank = (long long)ceil(percentile / 100 * total_);
+            rank = std::max(1LL, std::min(rank, total_));
+            long long seen = 0;
+            for (size_t i = 0; i < counts_.size(); i++) {
+                seen += counts_[i];
+                if (seen >= rank) {
+                    return std::min(highestEquivalentValue(i), max_);
+                }
+            }
+            return max_;
+        }
+
+        /*
+          Prints one line: count, mean and the usual percentiles, with
+          values divided by `unit` (e.g. 1000 to print microseconds).
+         */
+        void printSummary(const char* label, double unit, const char* unit_name) const {
+            printf("  %-28s n=%-8lld mean %9.2f  p50 %9.2f  p90 %9.2f  p99 %9.2f  p99.9 %9.2f  max %9.2f %s\n",
+                   label, total_, mean() / unit, valueAtPercentile(50) / unit,
+                   valueAtPercentile(90) / unit, valueAtPercentile(99) / unit,
+                   valueAtPercentile(99.9) / unit, max_ / unit, unit_name);
+        }
+
+        /*
+          Prints the percentile distribution in the layout of
+          HdrHistogram's .hgrm output, with `ticks_per_half_distance`
+          lines per halving of the remaining tail.
+         */
+        void printDistribution(double unit, int ticks_per_half_distance = 2) const {
+            printf("%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+            if (total_ == 0) {
+                return;
+            }
+            double percentile = 0;
+            double half_distance = 50;
+            int tick = 0;
+            while (true) {
+                long long value = valueAtPercentile(percentile);
+                long long below = countAtOrBelow(value);
+                double reported = 100.0 * below / total_;
+                if (below >= total_) {
+                    printf("%12.3f %2.12f %10lld\n", value / unit, 1.0, total_);
+                    break;
+                }
+                printf("%12.3f %2.12f %10lld %14.2f\n", value / unit, reported / 100, below,
+                       1.0 / (1.0 - reported / 100));
+                percentile += half_distance / ticks_per_half_distance;
+                if (++tick == ticks_per_half_distance) {
+                    tick = 0;
+                    half_distance /= 2;
+                }
+                if (half_distance < 1e-6) {
+                    percentile = 100;
+                }
+            }
+            printf("#[Mean    = %12.3f, StdDeviation   = %12.3f]\n", mean() / unit, stddev() / unit);
+            printf("#[Max     = %12.3f, Total count    = %12lld]\n", max_ / unit, total_);
+        }
+
+    private:
+        // 2^SUB_BUCKET_BITS sub-buckets cover the smallest values one to
+        // one; every later power of two reuses the upper half of them.
+        static const int SUB_BUCKET_BITS = 7;
+        static const int SUB_BUCKET_HALF = 1 << (SUB_BUCKET_BITS - 1);
+
+        static size_t bucketIndex(unsigned long long value) {
+            int msb = value == 0 ? 0 : 63 - __builtin_clzll(value);
+            int shift = std::max(0, msb - (SUB_BUCKET_BITS - 1));
+            return (size_t)shift * SUB_BUCKET_HALF + (size_t)(value >> shift);
+        }
+
+        static long long highestEquivalentValue(size_t index) {
+            if (index < (size_t)(2 * SUB_BUCKET_HALF)) {
+                return (long long)index;
+            }
+            size_t shift = (index - SUB_BUCKET_HALF) / SUB_BUCKET_HALF;
+            unsigned long long sub = index - shift * SUB_BUCKET_HALF;
+            return (long long)(((sub + 1) << shift) - 1);
+        }
+
+        long long countAtOrBelow(long long value) const {
+            long long seen = 0;
+            size_t last = bucketIndex((unsigned long long)value);
+            for (size_t i = 0; i <= last; i++) {
+                seen += counts_[i];
+            }
+            return seen;
+        }
+
+        std::vector<long long> counts_;
+        long long total_;
+        long long min_;
+        long long max_;
+        double sum_;
+        double sum_squares_;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef _PIPELINE_H
+#define _PIPELINE_H
+
+#include "itasksys.h"
+
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+/*
+ * PipelineFilter: one stage of a Pipeline.  Items flow through the
+ * filters in the order they were added to the pipeline.
+ *
+ *  - SERIAL_IN_ORDER: at most one item is processed at a time, and items
+ *    are processed in the order the first filter produced them.
+ *  - PARALLEL: any number of items may be processed concurrently.
+ *
+ * The first filter is the input of the pipeline and is always run
+ * serially: process() is called with a nullptr item and returns the next
+ * item of the stream, or nullptr once the stream has ended.  Every other
+ * filter receives the item returned by the previous filter and returns
+ * the item handed to the next filter.
+ */
+class PipelineFilter {
+    public:
+        enum Mode { SERIAL_IN_ORDER, PARALLEL };
+
+        PipelineFilter(Mode mode): mode_(mode) {}
+        virtual ~PipelineFilter() {}
+
+        virtual void* process(void* item) = 0;
+
+        Mode mode() const { return mode_; }
+
+    private:
+        Mode mode_;
+};
+
+/*
+ * Pipeline: streams items through a sequence of filters on a task system,
+ * with at most `max_tokens` items in flight.  The pipeline is executed as
+ * a single bulk task launch of `max_tokens` tasks.  Each task carries one
+ * item (token) at a time through all filters and then fetches the next
+ * item from the input filter, so no per-item launches are needed.
+ *
+ * A task only waits at a SERIAL_IN_ORDER filter for items that were
+ * fetched earlier by tasks that are already running, so the pipeline
+ * makes progress on any task system, including serial ones.
+ */
+class Pipeline {
+    public:
+        Pipeline(): runner_(this) {}
+
+        void addFilter(PipelineFilter* filter) {
+            filters_.push_back(filter);
+        }
+
+        /*
+          Runs the pipeline until the input filter returns nullptr.
+          Returns when all items have passed through all filters.
+         */
+        void run(ITaskSystem* t, int max_tokens) {
+            if (filters_.empty() || max_tokens <= 0) {
+                return;
+            }
+            next_seq_ = 0;
+            input_done_ = false;
+            stage_next_seq_.assign(filters_.size(), 0);
+            t->run(&runner_, max_tokens);
+        }
+
+    private:
+        class Runner: public IRunnable {
+            public:
+                Runner(Pipeline* pipeline): pipeline_(pipeline) {}
+                void runTask(int task_id, int num_total_tasks) {
+                    pipeline_->runToken();
+                }
+            private:
+                Pipeline* pipeline_;
+        };
+
+        void runToken() {
+            while (true) {
+                void* item;
+                long long seq;
+                {
+                    std::lock_guard<std::mutex> lock(input_lock_);
+                    if (input_done_) {
+                        return;
+                    }
+                    item = filters_[0]->process(nullptr);
+                    if (item == nullptr) {
+                        input_done_ = true;
+                        return;
+                    }
+                    seq = next_seq_++;
+                }
+                for (size_t i = 1; i < filters_.size(); i++) {
+                    if (filters_[i]->mode() == PipelineFilter::PARALLEL) {
+                        item = filters_[i]->process(item);
+                        continue;
+                    }
+                    std::unique_lock<std::mutex> lock(stage_lock_);
+                    stage_cv_.wait(lock, [&] { return stage_next_seq_[i] == seq; });
+                    lock.unlock();
+                    item = filters_[i]->process(item);
+                    lock.lock();
+                    stage_next_seq_[i]++;
+                    lock.unlock();
+                    stage_cv_.notify_all();
+                }
+            }
+        }
+
+        std::vector<PipelineFilter*> filters_;
+        Runner runner_;
+
+        // Input state, protected by input_lock_.
+        std::mutex input_lock_;
+        long long next_seq_;
+        bool input_done_;
+
+        // Sequence number of the next item each SERIAL_IN_ORDER filter
+        // may process, protected by stage_lock_.
+        std::mutex stage_lock_;
+        std::condition_variable stage_cv_;
+        std::vector<long long> stage_next_seq_;
+};
+
+#endif
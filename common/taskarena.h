@@ -0,0 +1,151 @@
+#ifndef _TASKARENA_H
+#define _TASKARENA_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <vector>
+
+/*
+ * Usage counters of one or more TaskArenas.
+ */
+struct TaskArenaStats {
+    // bytes obtained from the system allocator and held by the arenas
+    size_t bytes_reserved;
+    // bytes handed out since the last reset
+    size_t bytes_in_use;
+    // high-water mark of bytes_in_use
+    size_t peak_bytes_in_use;
+    // number of allocate() calls
+    long long allocations;
+    // number of times an arena was reset
+    long long resets;
+
+    TaskArenaStats()
+      : bytes_reserved(0), bytes_in_use(0), peak_bytes_in_use(0),
+        allocations(0), resets(0) {}
+
+    void add(const TaskArenaStats& other) {
+        bytes_reserved += other.bytes_reserved;
+        bytes_in_use += other.bytes_in_use;
+        peak_bytes_in_use += other.peak_bytes_in_use;
+        allocations += other.allocations;
+        resets += other.resets;
+    }
+};
+
+/*
+ * TaskArena: a bump allocator for scratch memory used inside
+ * IRunnable::runTask().  Every thread has its own arena, returned by
+ * TaskArena::current(), so allocating from it never takes a lock.
+ *
+ * Memory allocated while running a task of a bulk task launch stays
+ * valid until that launch completes.  Task systems reset the arenas of
+ * their worker threads once no launch that may have allocated from them
+ * is still running, so tasks never free arena memory themselves.
+ *
+ * Chunks are allocated and first touched by the thread that owns the
+ * arena, so on NUMA systems with the default first-touch policy the
+ * pages are placed on that thread's node.  Resetting keeps the chunks,
+ * so a warmed-up arena does not go back to the system allocator.
+ */
+class TaskArena {
+    public:
+        static const size_t DEFAULT_CHUNK_SIZE = 1 << 20;
+
+        TaskArena(size_t chunk_size = DEFAULT_CHUNK_SIZE)
+          : chunk_size_(chunk_size), chunk_(0), offset_(0), used_before_chunk_(0) {}
+
+        ~TaskArena() {
+            for (size_t i = 0; i < chunks_.size(); i++) {
+                free(chunks_[i].base);
+            }
+        }
+
+        /*
+          Returns `bytes` bytes aligned to `alignment` (a power of two).
+         */
+        void* allocate(size_t bytes, size_t alignment = 16) {
+            stats_.allocations++;
+            while (true) {
+                if (chunk_ < chunks_.size()) {
+                    Chunk& c = chunks_[chunk_];
+                    // malloc() only aligns the chunk to 16 bytes, so align
+                    // the address rather than the offset into the chunk.
+                    uintptr_t base = reinterpret_cast<uintptr_t>(c.base);
+                    size_t start = ((base + offset_ + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+                    if (start + bytes <= c.size) {
+                        offset_ = start + bytes;
+                        stats_.bytes_in_use = used_before_chunk_ + offset_;
+                        if (stats_.bytes_in_use > stats_.peak_bytes_in_use) {
+                            stats_.peak_bytes_in_use = stats_.bytes_in_use;
+                        }
+                        return c.base + start;
+                    }
+                    // Does not fit: move on to the next chunk.
+                    used_before_chunk_ += c.size;
+                    chunk_++;
+                    offset_ = 0;
+                    continue;
+                }
+                size_t size = chunk_size_;
+                if (bytes + alignment > size) {
+                    size = bytes + alignment;
+                }
+                Chunk c;
+                c.base = static_cast<char*>(malloc(size));
+                if (c.base == NULL) {
+                    throw std::bad_alloc();
+                }
+                c.size = size;
+                // First touch from the owning thread places the pages on
+                // its NUMA node.
+                memset(c.base, 0, size);
+                chunks_.push_back(c);
+                stats_.bytes_reserved += size;
+            }
+        }
+
+        /*
+          Releases everything allocated from the arena.  Must not be
+          called while the owning thread is running a task.
+         */
+        void reset() {
+            chunk_ = 0;
+            offset_ = 0;
+            used_before_chunk_ = 0;
+            stats_.bytes_in_use = 0;
+            stats_.resets++;
+        }
+
+        TaskArenaStats stats() const {
+            return stats_;
+        }
+
+        /*
+          Returns the arena of the calling thread.
+         */
+        static TaskArena* current() {
+            static thread_local TaskArena arena;
+            return &arena;
+        }
+
+    private:
+        struct Chunk {
+            char* base;
+            size_t size;
+        };
+
+        size_t chunk_size_;
+        std::vector<Chunk> chunks_;
+        // Index of the chunk being allocated from, the offset into it, and
+        // the total size of the chunks before it.
+        size_t chunk_;
+        size_t offset_;
+        size_t used_before_chunk_;
+        TaskArenaStats stats_;
+};
+
+#endif
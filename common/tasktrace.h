@@ -0,0 +1,314 @@
+#ifndef _TASKTRACE_H
+#define _TASKTRACE_H
+
+#include <stdio.h>
+#include <signal.h>
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "CycleTimer.h"
+
+/*
+ * TaskTrace: a flight recorder for task systems.  While tracing is
+ * enabled, every thread that records an event gets its own ring buffer
+ * holding its most recent events, so recording takes no locks and costs
+ * a few stores and a CycleTimer tick read.  While tracing is disabled,
+ * recording is a single relaxed load and nothing is allocated.
+ *
+ * Events:
+ *  - TASK: a task (or chunk of tasks) ran from `begin` to `end`.
+ *  - PARK: the thread slept from `begin` to `end` waiting for work.
+ *  - LAUNCH_SUBMIT / LAUNCH_READY / LAUNCH_COMPLETE: a bulk task launch
+ *    was submitted, had its dependencies satisfied, or completed.
+ *  - LAUNCH_DEP: a launch was submitted with a dependency on another
+ *    launch, recorded as given (before any pruning), so offline tools
+ *    can rebuild the task graph (see tests/analyze_trace.py).
+ *
+ * dump() writes the buffers as Chrome trace JSON, which chrome://tracing
+ * and ui.perfetto.dev open directly; each ring buffer is one track.  A
+ * buffer is handed to a new thread once its owner exits, so threads that
+ * are created per launch reuse a few tracks instead of growing memory.
+ *
+ * dump() and clear() should be called while no launches are in flight;
+ * a dump taken on SIGUSR1 (see dumpOnSignal()) while tasks run is best
+ * effort and may include a few torn events.
+ */
+class TaskTrace {
+    public:
+        enum EventType {
+            TASK,
+            PARK,
+            LAUNCH_SUBMIT,
+            LAUNCH_READY,
+            LAUNCH_COMPLETE,
+            LAUNCH_DEP,
+        };
+
+        // Events kept per thread; older events are overwritten.
+        static const size_t BUFFER_EVENTS = 1 << 16;
+
+        static void enable(bool on) {
+            enabledFlag().store(on, std::memory_order_relaxed);
+        }
+
+        static bool enabled() {
+            return enabledFlag().load(std::memory_order_relaxed);
+        }
+
+        /*
+          Returns the current tick count if tracing is enabled, or 0.
+          Pass the result as `begin` to span().
+         */
+        static CycleTimer::SysClock now() {
+            return enabled() ? CycleTimer::currentTicks() : 0;
+        }
+
+        /*
+          Records a TASK or PARK event from `begin` (a value returned by
+          now()) until now.  `task` and `count` describe the chunk of
+          tasks of `launch` that ran.
+         */
+        static void span(EventType type, CycleTimer::SysClock begin,
+                         int launch = -1, int task = -1, int count = 0) {
+            if (begin == 0 || !enabled()) {
+                return;
+            }
+            record(type, begin, CycleTimer::currentTicks(), launch, task, count);
+        }
+
+        /*
+          Records a LAUNCH_* event of launch `launch` with
+          `num_total_tasks` tasks.
+         */
+        static void instant(EventType type, int launch, int num_total_tasks) {
+            if (!enabled()) {
+                return;
+            }
+            CycleTimer::SysClock t = CycleTimer::currentTicks();
+            record(type, t, t, launch, -1, num_total_tasks);
+        }
+
+        /*
+          Records that launch `launch` depends on launch `dep`.  Task i
+          waits for tasks i-radius .. i+radius of `dep`, or for all of
+          its tasks if `radius` is negative.
+         */
+        static void dep(int launch, int dep, int radius) {
+            if (!enabled()) {
+                return;
+            }
+            CycleTimer::SysClock t = CycleTimer::currentTicks();
+            record(LAUNCH_DEP, t, t, launch, dep, radius);
+        }
+
+        /*
+          Drops all recorded events.
+         */
+        static void clear() {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock(r.lock);
+            for (Buffer* buffer : r.buffers) {
+                buffer->head.store(0, std::memory_order_release);
+            }
+        }
+
+        /*
+          Writes the recorded events to `path` as Chrome trace JSON,
+          labelled `label`.  Returns false if the file cannot be written.
+         */
+        static bool dump(const char* path, const char* label = "task system") {
+            FILE* f = fopen(path, "w");
+            if (!f) {
+                return false;
+            }
+            std::vector<std::vector<Event> > tracks;
+            {
+                Registry& r = registry();
+                std::lock_guard<std::mutex> lock(r.lock);
+                for (Buffer* buffer : r.buffers) {
+                    tracks.push_back(buffer->snapshot());
+                }
+            }
+            CycleTimer::SysClock base = ~0ULL;
+            for (const std::vector<Event>& events : tracks) {
+                for (const Event& e : events) {
+                    base = std::min(base, e.begin);
+                }
+            }
+            double us_per_tick = CycleTimer::secondsPerTick() * 1e6;
+            fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+            fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"%s\"}}", label);
+            for (size_t tid = 0; tid < tracks.size(); tid++) {
+                if (tracks[tid].empty()) {
+                    continue;
+                }
+                fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                        "\"args\":{\"name\":\"thread %d\"}}", (int)tid, (int)tid);
+                for (const Event& e : tracks[tid]) {
+                    double ts = (e.begin - base) * us_per_tick;
+                    if (e.type == TASK || e.type == PARK) {
+                        fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                                "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"launch\":%d,\"task\":%d,\"count\":%d}}",
+                                eventName(e.type), e.type == TASK ? "task" : "sched", (int)tid,
+                                ts, (e.end - e.begin) * us_per_tick, e.launch, e.task, e.count);
+                    } else if (e.type == LAUNCH_DEP) {
+                        fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"launch\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,"
+                                "\"tid\":%d,\"ts\":%.3f,\"args\":{\"launch\":%d,\"dep\":%d,\"radius\":%d}}",
+                                eventName(e.type), (int)tid, ts, e.launch, e.task, e.count);
+                    } else {
+                        fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"launch\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,"
+                                "\"tid\":%d,\"ts\":%.3f,\"args\":{\"launch\":%d,\"tasks\":%d}}",
+                                eventName(e.type), (int)tid, ts, e.launch, e.count);
+                    }
+                }
+            }
+            fprintf(f, "\n]}\n");
+            return fclose(f) == 0;
+        }
+
+        /*
+          Enables tracing and dumps the recorded events to `path`
+          whenever the process receives SIGUSR1.  The dump is written by a
+          background thread, not by the signal handler.
+         */
+        static void dumpOnSignal(const char* path) {
+            enable(true);
+            static std::string dump_path;
+            static std::once_flag once;
+            dump_path = path;
+            std::call_once(once, [] {
+                ::signal(SIGUSR1, onSignal);
+                std::thread([] {
+                    while (true) {
+                        usleep(100 * 1000);
+                        if (signalFlag()) {
+                            signalFlag() = 0;
+                            if (dump(dump_path.c_str())) {
+                                fprintf(stderr, "trace written to %s\n", dump_path.c_str());
+                            }
+                        }
+                    }
+                }).detach();
+            });
+        }
+
+    private:
+        struct Event {
+            CycleTimer::SysClock begin;
+            CycleTimer::SysClock end;
+            int type;
+            int launch;
+            int task;
+            int count;
+        };
+
+        // Ring buffer of one thread.  Only the owner writes; head counts
+        // every event ever recorded since the last clear().
+        struct Buffer {
+            Event* events;
+            std::atomic<size_t> head;
+
+            Buffer(): events(new Event[BUFFER_EVENTS]), head(0) {}
+
+            std::vector<Event> snapshot() {
+                size_t end = head.load(std::memory_order_acquire);
+                size_t begin = end > BUFFER_EVENTS ? end - BUFFER_EVENTS : 0;
+                std::vector<Event> copy;
+                for (size_t i = begin; i < end; i++) {
+                    copy.push_back(events[i % BUFFER_EVENTS]);
+                }
+                return copy;
+            }
+        };
+
+        struct Registry {
+            std::mutex lock;
+            // every buffer ever created, in track order, and the ones
+            // whose owner thread has exited
+            std::vector<Buffer*> buffers;
+            std::vector<Buffer*> free_buffers;
+        };
+
+        // Returns the calling thread's buffer to the free list when the
+        // thread exits.
+        struct ThreadBuffer {
+            Buffer* buffer;
+            ThreadBuffer(): buffer(nullptr) {}
+            ~ThreadBuffer() {
+                if (buffer) {
+                    Registry& r = registry();
+                    std::lock_guard<std::mutex> lock(r.lock);
+                    r.free_buffers.push_back(buffer);
+                }
+            }
+        };
+
+        static void record(EventType type, CycleTimer::SysClock begin, CycleTimer::SysClock end,
+                           int launch, int task, int count) {
+            Buffer* buffer = threadBuffer();
+            size_t h = buffer->head.load(std::memory_order_relaxed);
+            Event& e = buffer->events[h % BUFFER_EVENTS];
+            e.begin = begin;
+            e.end = end;
+            e.type = type;
+            e.launch = launch;
+            e.task = task;
+            e.count = count;
+            buffer->head.store(h + 1, std::memory_order_release);
+        }
+
+        static Buffer* threadBuffer() {
+            static thread_local ThreadBuffer slot;
+            if (!slot.buffer) {
+                Registry& r = registry();
+                std::lock_guard<std::mutex> lock(r.lock);
+                if (r.free_buffers.empty()) {
+                    r.buffers.push_back(new Buffer());
+                    slot.buffer = r.buffers.back();
+                } else {
+                    slot.buffer = r.free_buffers.back();
+                    r.free_buffers.pop_back();
+                }
+            }
+            return slot.buffer;
+        }
+
+        static const char* eventName(int type) {
+            switch (type) {
+            case TASK: return "task";
+            case PARK: return "park";
+            case LAUNCH_SUBMIT: return "launch submit";
+            case LAUNCH_READY: return "launch ready";
+            case LAUNCH_DEP: return "launch dep";
+            default: return "launch complete";
+            }
+        }
+
+        static void onSignal(int) {
+            signalFlag() = 1;
+        }
+
+        // Never destroyed, so threads exiting during static destruction
+        // can still return their buffers.
+        static Registry& registry() {
+            static Registry* r = new Registry();
+            return *r;
+        }
+
+        static std::atomic<bool>& enabledFlag() {
+            static std::atomic<bool> flag(false);
+            return flag;
+        }
+
+        static volatile sig_atomic_t& signalFlag() {
+            static volatile sig_atomic_t flag = 0;
+            return flag;
+        }
+};
+
+#endif
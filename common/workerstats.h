@@ -0,0 +1,128 @@
+#ifndef _WORKERSTATS_H
+#define _WORKERSTATS_H
+
+#include <atomic>
+
+#include "CycleTimer.h"
+
+/*
+ * Counters of one worker thread of a task system.
+ */
+struct WorkerStats {
+    // tasks run by the worker
+    long long tasks_executed;
+    // times the worker took work from the scheduler (one task, or a
+    // token it keeps claiming tasks with)
+    long long chunks_claimed;
+    // attempts to take work from another worker's queue, and how many
+    // of them found work
+    long long steals_attempted;
+    long long steals_succeeded;
+    // times the worker was woken after parking
+    long long wakeups;
+    // bulk task launches whose last task the worker finished
+    long long launches_completed;
+    // time spent running tasks
+    double busy_seconds;
+    // time awake without running a task: looking for work, waiting for
+    // the scheduler's locks and bookkeeping
+    double spinning_seconds;
+    // time asleep waiting to be woken
+    double parked_seconds;
+
+    WorkerStats()
+      : tasks_executed(0), chunks_claimed(0), steals_attempted(0),
+        steals_succeeded(0), wakeups(0), launches_completed(0),
+        busy_seconds(0), spinning_seconds(0), parked_seconds(0) {}
+
+    void add(const WorkerStats& other) {
+        tasks_executed += other.tasks_executed;
+        chunks_claimed += other.chunks_claimed;
+        steals_attempted += other.steals_attempted;
+        steals_succeeded += other.steals_succeeded;
+        wakeups += other.wakeups;
+        launches_completed += other.launches_completed;
+        busy_seconds += other.busy_seconds;
+        spinning_seconds += other.spinning_seconds;
+        parked_seconds += other.parked_seconds;
+    }
+};
+
+/*
+ * WorkerCounters: the counters a task system keeps for one of its worker
+ * threads.  Only the owning worker updates them, with plain relaxed loads
+ * and stores rather than atomic read-modify-writes, so counting costs no
+ * more than incrementing a local variable.  Other threads may call
+ * snapshot() at any time.  Keep one per worker in an array: the padding
+ * puts the counters of neighbouring workers on different cache lines.
+ *
+ * Time is attributed with account(): each call charges the ticks since
+ * the previous call (or start()) to the given category.
+ */
+class WorkerCounters {
+    public:
+        enum Counter {
+            TASKS_EXECUTED,
+            CHUNKS_CLAIMED,
+            STEALS_ATTEMPTED,
+            STEALS_SUCCEEDED,
+            WAKEUPS,
+            LAUNCHES_COMPLETED,
+            BUSY_TICKS,
+            SPINNING_TICKS,
+            PARKED_TICKS,
+            NUM_COUNTERS,
+        };
+
+        WorkerCounters(): mark_(0) {
+            for (int i = 0; i < NUM_COUNTERS; i++) {
+                values_[i].store(0, std::memory_order_relaxed);
+            }
+        }
+
+        void add(Counter counter, long long n = 1) {
+            std::atomic<long long>& value = values_[counter];
+            value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        /*
+          Starts the clock used by account().  Called by the worker
+          before its first call to account().
+         */
+        void start() {
+            mark_ = CycleTimer::currentTicks();
+        }
+
+        void account(Counter counter) {
+            CycleTimer::SysClock now = CycleTimer::currentTicks();
+            add(counter, (long long)(now - mark_));
+            mark_ = now;
+        }
+
+        WorkerStats snapshot() const {
+            double seconds_per_tick = CycleTimer::secondsPerTick();
+            WorkerStats stats;
+            stats.tasks_executed = load(TASKS_EXECUTED);
+            stats.chunks_claimed = load(CHUNKS_CLAIMED);
+            stats.steals_attempted = load(STEALS_ATTEMPTED);
+            stats.steals_succeeded = load(STEALS_SUCCEEDED);
+            stats.wakeups = load(WAKEUPS);
+            stats.launches_completed = load(LAUNCHES_COMPLETED);
+            stats.busy_seconds = load(BUSY_TICKS) * seconds_per_tick;
+            stats.spinning_seconds = load(SPINNING_TICKS) * seconds_per_tick;
+            stats.parked_seconds = load(PARKED_TICKS) * seconds_per_tick;
+            return stats;
+        }
+
+    private:
+        long long load(Counter counter) const {
+            return values_[counter].load(std::memory_order_relaxed);
+        }
+
+        std::atomic<long long> values_[NUM_COUNTERS];
+        // Start of the interval account() charges next; owner only.
+        CycleTimer::SysClock mark_;
+        char pad_[64];
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "tasksys.h"
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 
@@ -8,6 +9,63 @@ IRunnable::~IRunnable() {}
 ITaskSystem::ITaskSystem(int num_threads) {}
 ITaskSystem::~ITaskSystem() {}
 
+TaskID ITaskSystem::runAsyncWithTaskDeps(IRunnable* runnable, int num_total_tasks,
+                                         const std::vector<TaskDep>& deps) {
+    std::vector<TaskID> launch_deps;
+    for (const TaskDep& dep : deps) {
+        launch_deps.push_back(dep.launch);
+    }
+    return runAsyncWithDeps(runnable, num_total_tasks, launch_deps);
+}
+
+void ITaskSystem::submitBatch(const LaunchDesc* descs, int count, TaskID* out_ids) {
+    std::vector<TaskID> deps;
+    for (int i = 0; i < count; i++) {
+        deps = descs[i].deps;
+        for (int idx : descs[i].batch_deps) {
+            deps.push_back(out_ids[idx]);
+        }
+        out_ids[i] = runAsyncWithDeps(descs[i].runnable, descs[i].num_total_tasks, deps);
+    }
+}
+
+TaskID ITaskSystem::createEvent() {
+    return -1;
+}
+
+void ITaskSystem::signal(TaskID event) {}
+
+TaskArenaStats ITaskSystem::arenaStats() {
+    return TaskArena::current()->stats();
+}
+
+void ITaskSystem::setDepPruningWindow(int window) {}
+
+DepPruningStats ITaskSystem::depPruningStats() {
+    return DepPruningStats();
+}
+
+WakeupStats ITaskSystem::wakeupStats() {
+    return WakeupStats();
+}
+
+bool ITaskSystem::allocationFreeLaunches() {
+    return false;
+}
+
+TaskSystemStats ITaskSystem::stats() {
+    TaskSystemStats stats;
+    stats.arena = arenaStats();
+    stats.dep_pruning = depPruningStats();
+    stats.wakeup = wakeupStats();
+    return stats;
+}
+
+void ITaskSystem::then(TaskID task_id, const std::function<void()>& continuation) {
+    sync();
+    continuation();
+}
+
 /*
  * ================================================================
  * Serial task system implementation
@@ -28,6 +86,8 @@ void TaskSystemSerial::run(IRunnable* runnable, int num_total_tasks) {
     for (int i = 0; i < num_total_tasks; i++) {
         runnable->runTask(i, num_total_tasks);
     }
+    // 本次启动完成，释放任务在调用线程 arena 上分配的临时内存
+    TaskArena::current()->reset();
 }
 
 TaskID TaskSystemSerial::runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
@@ -71,16 +131,12 @@ TaskSystemParallelSpawn::TaskSystemParallelSpawn(int num_threads): ITaskSystem(n
     //
     // 设置线程数
     this->thread_num = num_threads;
-    // 创建线程数组
-    this->thread_pool = new std::thread[this->thread_num];
+    this->next_launch_id = 0;
 }
 
 TaskSystemParallelSpawn::~TaskSystemParallelSpawn() {
     // 重置线程数
     this->thread_num = -1;
-    // 销毁线程数组
-    delete[] this->thread_pool;
-    this->thread_pool = nullptr;
 }
 
 void TaskSystemParallelSpawn::runThread(IRunnable *runnable, int task_id_start, int task_num, int num_total_tasks) {
@@ -96,24 +152,33 @@ void TaskSystemParallelSpawn::run(IRunnable* runnable, int num_total_tasks) {
     // tasks sequentially on the calling thread.
     //
     // 这里采用静态任务分配
+    // 线程数组是每次调用局部的，多个线程可以同时调用 run()
+    std::vector<std::thread> threads(this->thread_num);
+    int launch_id = this->next_launch_id++;
+    TaskTrace::instant(TaskTrace::LAUNCH_SUBMIT, launch_id, num_total_tasks);
+    TaskTrace::instant(TaskTrace::LAUNCH_READY, launch_id, num_total_tasks);
     int k = 0;
     int task_per_thread = num_total_tasks / this->thread_num;
     for (int i = 0; i < num_total_tasks; i += task_per_thread) {
         // 前面几个线程多承担一个任务，分掉不能整除的部分
-        if(k < num_total_tasks % this->thread_num) {
-            this->thread_pool[k] = std::thread(runThread, runnable, i, task_per_thread + 1, num_total_tasks);
+        int task_num = task_per_thread;
+        if(k < num_total_tasks % this->thread_num)
+            task_num++;
+        threads[k] = std::thread([=]() {
+            CycleTimer::SysClock begin = TaskTrace::now();
+            runThread(runnable, i, task_num, num_total_tasks);
+            TaskTrace::span(TaskTrace::TASK, begin, launch_id, i, task_num);
+        });
+        if(task_num > task_per_thread)
             i++;
-        }
-        else {
-            this->thread_pool[k] = std::thread(runThread, runnable, i, task_per_thread, num_total_tasks);
-        }
         k++;
     }
     assert(k == this->thread_num || this->thread_num > num_total_tasks);
     // 等待线程结束 (不一定所有线程都分配到了任务)
     for (int i = 0; i < k; i++) {
-        this->thread_pool[i].join();
+        threads[i].join();
     }
+    TaskTrace::instant(TaskTrace::LAUNCH_COMPLETE, launch_id, num_total_tasks);
 }
 
 TaskID TaskSystemParallelSpawn::runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
@@ -129,175 +194,370 @@ void TaskSystemParallelSpawn::sync() {
 
 /*
  * ================================================================
- * Parallel Thread Pool Spinning Task System Implementation
+ * Partition policies
  * ================================================================
  */
 
-const char* TaskSystemParallelThreadPoolSpinning::name() {
-    return "Parallel + Thread Pool + Spin";
+const char* StaticPartition::name() {
+    return "static";
 }
 
-// 您在步骤1中的实现会因为每次调用run()时创建线程而产生开销。当任务计算量较小时，这种开销尤为明显。
-// 此时，我们建议您转向"线程池"实现，即您的任务执行系统预先创建所有工作线程（例如在TaskSystem构造期间，
-// 或在首次调用run()时）。
+inline int StaticPartition::chunkSize(int remaining, int num_total_tasks, int num_threads) {
+    // 每个 worker 一块，前面的块多分一个任务，分掉不能整除的部分
+    return std::min(remaining, (num_total_tasks + num_threads - 1) / num_threads);
+}
 
-// 作为初始实现，我们建议您设计工作线程持续循环，始终检查是否有更多工作需要执行（线程进入while循环直到
-// 条件满足，这通常被称为"自旋"）。工作线程如何判断是否有工作需要做？这个属于任务动态分配   
+const char* DynamicPartition::name() {
+    return "dynamic";
+}
 
-// 现在要确保run()实现所需的同步行为已非易事。您需要如何改变run()的实现来确定批量任务启动中的所有任务已完成？
+inline int DynamicPartition::chunkSize(int remaining, int num_total_tasks, int num_threads) {
+    return 1;
+}
 
-// -------- checked
-TaskSystemParallelThreadPoolSpinning::TaskSystemParallelThreadPoolSpinning(int num_threads): ITaskSystem(num_threads) {
-    //
-    // TODO: CS149 student implementations may decide to perform setup
-    // operations (such as thread pool construction) here.
-    // Implementations are free to add new class member variables
-    // (requiring changes to tasksys.h).
-    //
-    // 创建线程池
-    this->thread_num = num_threads;
-    this->thread_pool = new std::thread[this->thread_num];
-    // NOTE: 除了线程以外的成员变量必须在创建线程池之前初始化，否则 worker 可能会使用随机初始值执行一些指令
-    // 初始设置 stop 为 false
-    this->stop = false;
-    // 初始任务设置为 NULL，任务数量设置为 0, 正在工作的 workers = 0
-    this->runnable = nullptr;
-    this->num_total_tasks = 0;
-    this->finished_tasks_num = 0;
-    this->num_working_workers = 0;
-    // 分配 worker，worker != 任务，worker 可以持续执行不同的任务，直到用户决定停止
-    for (int i = 0; i < this->thread_num; i++) {
-        this->thread_pool[i] = std::thread([this, i]() {
-            worker(i);
-        });
+const char* GuidedPartition::name() {
+    return "guided";
+}
+
+inline int GuidedPartition::chunkSize(int remaining, int num_total_tasks, int num_threads) {
+    // 与 OpenMP 的 schedule(guided) 相同：剩余任务按线程数均分，块越来越小，最小为 1
+    return std::max(1, remaining / num_threads);
+}
+
+/*
+ * ================================================================
+ * Queue policies
+ * ================================================================
+ */
+
+MutexQueue::MutexQueue(int num_threads): num_threads(num_threads), num_launches(0) {}
+
+const char* MutexQueue::name() {
+    return "mutex queue";
+}
+
+template <class Partition>
+void MutexQueue::push(PoolLaunch* launch) {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->launches.push_back(launch);
+    this->num_launches++;
+}
+
+template <class Partition>
+bool MutexQueue::pop(int thread_id, WorkItem& item, WorkerCounters& counters) {
+    std::lock_guard<std::mutex> guard(this->lock);
+    if (this->launches.empty())
+        return false;
+    // 从队首的启动领取一块任务，任务领完后出队 (但要等所有任务完成，调用 run() 的线程才会返回)
+    PoolLaunch* launch = this->launches.front();
+    int chunk = Partition::chunkSize(launch->num_total_tasks - launch->next_task,
+                                     launch->num_total_tasks, this->num_threads);
+    item.launch = launch;
+    item.begin = launch->next_task;
+    item.end = launch->next_task + chunk;
+    launch->next_task = item.end;
+    if (launch->next_task == launch->num_total_tasks) {
+        this->launches.pop_front();
+        this->num_launches--;
     }
+    return true;
 }
 
-// -------- checking
-void TaskSystemParallelThreadPoolSpinning::worker(int thread_id) {
-    // 只要 stop 不为 true, worker 永不停止  
-    while(!this->stop) {
-        // NOTE: 这里 runnable 充当了一个 “开始键”
-        this->compare_lock.lock();
-        if(!this->runnable) {
-            this->compare_lock.unlock();
-            std::this_thread::yield(); // 让出 CPU 时间片，减少自旋等待
-            continue;
+inline bool MutexQueue::hasWork() {
+    return this->num_launches.load() > 0;
+}
+
+LockFreeQueue::LockFreeQueue(int num_threads): num_threads(num_threads), num_active(0) {
+    for (int i = 0; i < NUM_SLOTS; i++) {
+        // 第 0 代，没有任务可领取
+        this->slots[i].claim.store(0);
+        this->slots[i].launch.store(nullptr);
+        this->slots[i].num_total_tasks.store(0);
+        this->slots[i].busy.store(false);
+    }
+}
+
+const char* LockFreeQueue::name() {
+    return "lock-free queue";
+}
+
+template <class Partition>
+void LockFreeQueue::push(PoolLaunch* launch) {
+    while (true) {
+        for (int i = 0; i < NUM_SLOTS; i++) {
+            Slot& slot = this->slots[i];
+            bool expected = false;
+            if (!slot.busy.compare_exchange_strong(expected, true))
+                continue;
+            // 先换代并关闭槽位，再写入启动：读到新 num_total_tasks 的 worker 用旧代数的 CAS 必然失败
+            unsigned long long generation = (slot.claim.load() >> 32) + 1;
+            slot.claim.store((generation << 32) | CLOSED);
+            slot.launch.store(launch, std::memory_order_relaxed);
+            slot.num_total_tasks.store(launch->num_total_tasks, std::memory_order_release);
+            this->num_active++;
+            slot.claim.store(generation << 32, std::memory_order_release);
+            return;
         }
-        // 下面这个循环一直持续到把所有任务完成为止
-        while(this->finished_tasks_num < this->num_total_tasks) {
-            if(this->finished_tasks_num + this->num_working_workers >= this->num_total_tasks)
+        // 槽位全满，等某个启动的任务领完
+        std::this_thread::yield();
+    }
+}
+
+template <class Partition>
+bool LockFreeQueue::pop(int thread_id, WorkItem& item, WorkerCounters& counters) {
+    for (int i = 0; i < NUM_SLOTS; i++) {
+        Slot& slot = this->slots[i];
+        unsigned long long claim = slot.claim.load(std::memory_order_acquire);
+        while (true) {
+            int next = (int)(claim & CLOSED);
+            int num_total_tasks = slot.num_total_tasks.load(std::memory_order_acquire);
+            if ((claim & CLOSED) == CLOSED || next >= num_total_tasks)
                 break;
-            int cur_task_id = this->finished_tasks_num + this->num_working_workers;
-            this->num_working_workers++;
-            assert(this->num_working_workers <= this->thread_num);
-            this->compare_lock.unlock();
-            runThread(this->runnable, cur_task_id, 1, this->num_total_tasks);
-            this->compare_lock.lock();
-            this->finished_tasks_num++;
-            this->num_working_workers--;
+            PoolLaunch* launch = slot.launch.load(std::memory_order_relaxed);
+            int chunk = Partition::chunkSize(num_total_tasks - next, num_total_tasks, this->num_threads);
+            // CAS 成功说明槽位仍是读到的这一代，上面读到的启动和任务量有效；失败时 claim 被更新为新值，重试
+            if (!slot.claim.compare_exchange_weak(claim, claim + chunk, std::memory_order_acq_rel,
+                                                  std::memory_order_acquire))
+                continue;
+            item.launch = launch;
+            item.begin = next;
+            item.end = next + chunk;
+            // 领走最后一块的 worker 释放槽位，之后槽位可以被复用
+            if (item.end == num_total_tasks) {
+                this->num_active--;
+                slot.busy.store(false, std::memory_order_release);
+            }
+            return true;
         }
-        this->compare_lock.unlock();
-        std::this_thread::yield(); // 让出 CPU 时间片，减少自旋
     }
+    return false;
 }
 
-// 执行到这里说明前面调用的 run() 已经退出，而 run 只有在 workers 结束才能退出
-// 所以这里假设 worker 已完成所有任务
-TaskSystemParallelThreadPoolSpinning::~TaskSystemParallelThreadPoolSpinning() {
-    // 要退出，设置 stop 为 true 通知 worker 退出
-    this->stop = true;
-    std::this_thread::yield(); // 让出 CPU 时间片，等待 workers 结束
-    // join 必须放在这里，因为线程池实现中，run() 会被调用很多遍，而构造函数和析构函数可能只会被调用一遍
-    for (int i = 0; i < this->thread_num; i++) {
-        this->thread_pool[i].join();
+inline bool LockFreeQueue::hasWork() {
+    return this->num_active.load() > 0;
+}
+
+WorkStealingQueue::WorkStealingQueue(int num_threads)
+  : num_threads(num_threads), next_deque(0), num_items(0) {
+    this->deques = new WorkerDeque[num_threads];
+}
+
+WorkStealingQueue::~WorkStealingQueue() {
+    delete[] this->deques;
+}
+
+const char* WorkStealingQueue::name() {
+    return "work stealing";
+}
+
+template <class Partition>
+void WorkStealingQueue::push(PoolLaunch* launch) {
+    // 提交时就按划分策略把启动切成 WorkItem，轮流分给各个 worker 的 deque
+    int n = launch->num_total_tasks;
+    int target = this->next_deque++ % this->num_threads;
+    for (int begin = 0; begin < n; ) {
+        int chunk = Partition::chunkSize(n - begin, n, this->num_threads);
+        WorkItem item = { launch, begin, begin + chunk };
+        // 先计数再入队，保证有 WorkItem 时 hasWork() 一定为真
+        this->num_items++;
+        WorkerDeque& deque = this->deques[target];
+        {
+            std::lock_guard<std::mutex> guard(deque.lock);
+            deque.items.push_back(item);
+        }
+        begin += chunk;
+        target = (target + 1) % this->num_threads;
     }
-    // 销毁线程池
-    this->thread_num = -1;
-    delete[] this->thread_pool;
-    this->thread_pool = nullptr;
-    // 任务设置为空，任务数量设置为 0，正在工作的 workers = 0
-    this->runnable = nullptr;
-    this->num_total_tasks = 0;
-    this->finished_tasks_num = 0;
-    this->num_working_workers = 0;
 }
 
-void TaskSystemParallelThreadPoolSpinning::runThread(IRunnable *runnable, int task_id_start, int task_num, int num_total_tasks) {
-    for(int i = 0; i < task_num; i++) {
-        runnable->runTask(task_id_start + i, num_total_tasks);
+template <class Partition>
+bool WorkStealingQueue::pop(int thread_id, WorkItem& item, WorkerCounters& counters) {
+    // 先从自己的 deque 尾部取最新的 WorkItem
+    {
+        WorkerDeque& own = this->deques[thread_id];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.items.empty()) {
+            item = own.items.back();
+            own.items.pop_back();
+            this->num_items--;
+            return true;
+        }
     }
+    // 自己的 deque 空了，依次从其他 worker 的 deque 头部偷最旧的
+    for (int k = 1; k < this->num_threads; k++) {
+        WorkerDeque& victim = this->deques[(thread_id + k) % this->num_threads];
+        counters.add(WorkerCounters::STEALS_ATTEMPTED);
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.items.empty()) {
+            item = victim.items.front();
+            victim.items.pop_front();
+            this->num_items--;
+            counters.add(WorkerCounters::STEALS_SUCCEEDED);
+            return true;
+        }
+    }
+    return false;
 }
 
-void TaskSystemParallelThreadPoolSpinning::run(IRunnable* runnable, int num_total_tasks) {
-    //
-    // TODO: CS149 students will modify the implementation of this
-    // method in Part A.  The implementation provided below runs all
-    // tasks sequentially on the calling thread.
-    //
-    // 初始化并行任务所需参数，包括正在工作的workers数目，任务函数 runnable，任务总量
-    // NOTE: run() 要等待 worker 执行完毕才可返回
-    this->compare_lock.lock();
-    this->num_total_tasks = num_total_tasks;
-    this->finished_tasks_num = 0;
-    this->num_working_workers = 0;
-    this->runnable = runnable;
-    this->compare_lock.unlock();
-
-    while(this->finished_tasks_num < num_total_tasks) {
+inline bool WorkStealingQueue::hasWork() {
+    return this->num_items.load() > 0;
+}
+
+/*
+ * ================================================================
+ * Wait policies
+ * ================================================================
+ */
+
+SpinWait::SpinWait(int num_threads) {}
+
+const char* SpinWait::name() {
+    return "spin";
+}
+
+template <class Pred>
+void SpinWait::workerWait(int thread_id, Pred ready, WorkerCounters& counters) {
+    while (!ready())
         std::this_thread::yield(); // 让出 CPU 时间片，减少自旋等待
+}
+
+template <class Pred>
+void SpinWait::callerWait(Pred done) {
+    while (!done())
+        std::this_thread::yield();
+}
+
+inline void SpinWait::notifyWorkers(int count) {}
+
+inline void SpinWait::notifyCaller() {}
+
+inline void SpinWait::notifyAll() {}
+
+WakeupStats SpinWait::stats() {
+    return WakeupStats();
+}
+
+SleepWait::SleepWait(int num_threads): num_threads(num_threads) {
+    this->worker_cvs = new std::condition_variable[num_threads];
+    this->worker_signaled.assign(num_threads, false);
+    this->idle_workers.reserve(num_threads);
+}
+
+SleepWait::~SleepWait() {
+    delete[] this->worker_cvs;
+}
+
+const char* SleepWait::name() {
+    return "sleep";
+}
+
+template <class Pred>
+void SleepWait::workerWait(int thread_id, Pred ready, WorkerCounters& counters) {
+    // 在锁内检查 ready()：提交者入队后要拿同一把锁才能唤醒，不会错过唤醒
+    std::unique_lock<std::mutex> guard(this->lock);
+    while (!ready()) {
+        // 登记为空闲并陷入睡眠，直到被单独唤醒
+        this->idle_workers.push_back(thread_id);
+        counters.account(WorkerCounters::SPINNING_TICKS);
+        CycleTimer::SysClock park_begin = TaskTrace::now();
+        this->worker_cvs[thread_id].wait(guard, [this, thread_id] { return this->worker_signaled[thread_id]; });
+        TaskTrace::span(TaskTrace::PARK, park_begin);
+        counters.account(WorkerCounters::PARKED_TICKS);
+        counters.add(WorkerCounters::WAKEUPS);
+        this->worker_signaled[thread_id] = false;
+        // 被唤醒却没有拿到工作
+        if (!ready())
+            this->wakeup_stats.spurious_wakeups++;
     }
-    assert(this->finished_tasks_num == num_total_tasks);
-    // 这次run结束后，重置任务设置为空，任务数量设置为 0，正在工作的 workers = 0
-    this->compare_lock.lock();
-    this->runnable = nullptr;
-    this->num_total_tasks = 0;
-    this->finished_tasks_num = 0;
-    this->num_working_workers = 0;
-    this->compare_lock.unlock();
+}
 
+template <class Pred>
+void SleepWait::callerWait(Pred done) {
+    std::unique_lock<std::mutex> guard(this->lock);
+    this->caller_cv.wait(guard, done);
 }
 
-TaskID TaskSystemParallelThreadPoolSpinning::runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
-                                                              const std::vector<TaskID>& deps) {
-    // You do not need to implement this method.
-    return 0;
+void SleepWait::wake(int count) {
+    // 只唤醒 min(count, 睡眠的 worker 数) 个 worker，优先唤醒刚睡下、缓存还热的 worker
+    while (count > 0 && !this->idle_workers.empty()) {
+        int id = this->idle_workers.back();
+        this->idle_workers.pop_back();
+        this->worker_signaled[id] = true;
+        this->worker_cvs[id].notify_one();
+        this->wakeup_stats.wakeups++;
+        count--;
+    }
 }
 
-void TaskSystemParallelThreadPoolSpinning::sync() {
-    // You do not need to implement this method.
-    return;
+void SleepWait::notifyWorkers(int count) {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->wakeup_stats.launches++;
+    // 任务数少于睡眠的 worker 数时只唤醒需要的几个，避免惊群
+    wake(count);
+}
+
+void SleepWait::notifyCaller() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->caller_cv.notify_all();
+}
+
+void SleepWait::notifyAll() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    wake(this->num_threads);
+}
+
+WakeupStats SleepWait::stats() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->wakeup_stats;
+}
+
+HybridWait::HybridWait(int num_threads): SleepWait(num_threads) {}
+
+const char* HybridWait::name() {
+    return "hybrid";
+}
+
+template <class Pred>
+void HybridWait::workerWait(int thread_id, Pred ready, WorkerCounters& counters) {
+    // 先自旋一段时间，短暂的空闲不必付出睡眠和唤醒的代价
+    for (int i = 0; i < SPIN_POLLS; i++) {
+        if (ready())
+            return;
+        std::this_thread::yield();
+    }
+    SleepWait::workerWait(thread_id, ready, counters);
+}
+
+template <class Pred>
+void HybridWait::callerWait(Pred done) {
+    for (int i = 0; i < SPIN_POLLS; i++) {
+        if (done())
+            return;
+        std::this_thread::yield();
+    }
+    SleepWait::callerWait(done);
 }
 
 /*
  * ================================================================
- * Parallel Thread Pool Sleeping Task System Implementation
+ * Policy-based thread pool implementation
  * ================================================================
  */
 
-const char* TaskSystemParallelThreadPoolSleeping::name() {
-    return "Parallel + Thread Pool + Sleep";
-}
-
-TaskSystemParallelThreadPoolSleeping::TaskSystemParallelThreadPoolSleeping(int num_threads): ITaskSystem(num_threads) {
-    //
-    // TODO: CS149 student implementations may decide to perform setup
-    // operations (such as thread pool construction) here.
-    // Implementations are free to add new class member variables
-    // (requiring changes to tasksys.h).
-    //
+template <class QueuePolicy, class WaitPolicy, class PartitionPolicy>
+ThreadPoolTaskSystem<QueuePolicy, WaitPolicy, PartitionPolicy>::ThreadPoolTaskSystem(int num_threads)
+  : ITaskSystem(num_threads), queue(num_threads), waiter(num_threads) {
+    this->pool_name = std::string("Thread Pool: ") + QueuePolicy::name() + " + " +
+                      WaitPolicy::name() + " + " + PartitionPolicy::name();
     // 创建线程池
     this->thread_num = num_threads;
     this->thread_pool = new std::thread[this->thread_num];
     // NOTE: 除了线程以外的成员变量必须在创建线程池之前初始化，否则 worker 可能会使用随机初始值执行一些指令
-    // 初始设置 stop 为 false
+    this->next_launch_id = 0;
     this->stop = false;
-    // 初始任务设置为 NULL，任务数量设置为 0, 正在工作的 workers = 0，活着的 workers = 0
-    this->runnable = nullptr;
-    this->num_total_tasks = 0;
-    this->finished_tasks_num = 0;
-    this->num_working_workers = 0;
-    this->alive_workers.store(0, std::memory_order_relaxed);
+    this->arenas.assign(this->thread_num, nullptr);
+    this->arena_live_launches.assign(this->thread_num, 0);
+    this->counters = new WorkerCounters[this->thread_num];
     // 分配 worker，worker != 任务，worker 可以持续执行不同的任务，直到用户决定停止
     for (int i = 0; i < this->thread_num; i++) {
         this->thread_pool[i] = std::thread([this, i]() {
@@ -306,119 +566,180 @@ TaskSystemParallelThreadPoolSleeping::TaskSystemParallelThreadPoolSleeping(int n
     }
 }
 
-void TaskSystemParallelThreadPoolSleeping::runThread(IRunnable *runnable, int task_id_start, int task_num, int num_total_tasks) {
-    for(int i = 0; i < task_num; i++) {
-        runnable->runTask(task_id_start + i, num_total_tasks);
+// 执行到这里说明前面调用的 run() 已经退出，worker 已完成所有任务
+template <class QueuePolicy, class WaitPolicy, class PartitionPolicy>
+ThreadPoolTaskSystem<QueuePolicy, WaitPolicy, PartitionPolicy>::~ThreadPoolTaskSystem() {
+    // 要退出，设置 stop 为 true 并叫醒所有 worker
+    this->stop = true;
+    this->waiter.notifyAll();
+    // join 必须放在这里，因为线程池实现中，run() 会被调用很多遍，而构造函数和析构函数可能只会被调用一遍
+    for (int i = 0; i < this->thread_num; i++) {
+        this->thread_pool[i].join();
     }
+    // 销毁线程池
+    this->thread_num = -1;
+    delete[] this->thread_pool;
+    this->thread_pool = nullptr;
+    delete[] this->counters;
+}
+
+template <class QueuePolicy, class WaitPolicy, class PartitionPolicy>
+const char* ThreadPoolTaskSystem<QueuePolicy, WaitPolicy, PartitionPolicy>::name() {
+    return this->pool_name.c_str();
 }
 
-void TaskSystemParallelThreadPoolSleeping::worker(int thread_id) {
-    // 活着的 workers + 1
-    this->alive_workers.fetch_add(1, std::memory_order_relaxed);
-    // 只要 stop 不为 true, worker 永不停止  
-    while(!this->stop.load(std::memory_order_relaxed)) {
-        // 控制每次任务启动的锁
-        std::unique_lock<std::mutex> lock(this->run_lock); 
-        // runnable == nullptr 时陷入睡眠
-        if(!this->runnable) {
+template <class QueuePolicy, class WaitPolicy, class PartitionPolicy>
+void ThreadPoolTaskSystem<QueuePolicy, WaitPolicy, PartitionPolicy>::worker(int thread_id) {
+    this->arena_lock.lock();
+    this->arenas[thread_id] = TaskArena::current();
+    this->arena_lock.unlock();
+    WorkerCounters& counters = this->counters[thread_id];
+    counters.start();
+    // 只要 stop 不为 true, worker 永不停止
+    while (true) {
+        WorkItem item;
+        if (!this->queue.template pop<PartitionPolicy>(thread_id, item, counters)) {
+            if (this->stop.load())
+                break;
+            this->waiter.workerWait(thread_id, [this] {
+                return this->stop.load() || this->queue.hasWork();
+            }, counters);
             continue;
         }
-        if(this->stop.load(std::memory_order_relaxed)) 
-            break;
-        // 此时 runnable 已被赋值，可以干活了
-        // 下面这个循环一直持续到把所有任务完成为止
-        while(this->finished_tasks_num < this->num_total_tasks) {
-            if(this->finished_tasks_num + this->num_working_workers >= this->num_total_tasks)
-                break;
-            int cur_task_id = this->finished_tasks_num + this->num_working_workers;
-            this->num_working_workers++;
-            assert(this->num_working_workers <= this->thread_num);
-            lock.unlock();
-            runThread(this->runnable, cur_task_id, 1, this->num_total_tasks);
-            lock.lock();
-            this->finished_tasks_num++;
-            this->num_working_workers--;
+        PoolLaunch* launch = item.launch;
+        int num_tasks = item.end - item.begin;
+        // 第一次执行本次启动的任务前登记 arena，之后才会在 arena 上分配内存
+        if (!launch->arena_users[thread_id]) {
+            std::lock_guard<std::mutex> guard(this->arena_lock);
+            launch->arena_users[thread_id] = 1;
+            this->arena_live_launches[thread_id]++;
+        }
+        // 领取任务之前 (包括等待和空转) 的时间记为 spinning
+        counters.add(WorkerCounters::CHUNKS_CLAIMED);
+        counters.account(WorkerCounters::SPINNING_TICKS);
+        CycleTimer::SysClock begin = TaskTrace::now();
+        for (int i = item.begin; i < item.end; i++) {
+            launch->runnable->runTask(i, launch->num_total_tasks);
         }
-        assert(this->finished_tasks_num <= this->num_total_tasks);
-        if(this->finished_tasks_num == this->num_total_tasks) {
-            this->runnable = nullptr;
-            this->run_cv.notify_one(); // 唤醒主线程
+        TaskTrace::span(TaskTrace::TASK, begin, launch->id, item.begin, num_tasks);
+        counters.account(WorkerCounters::BUSY_TICKS);
+        counters.add(WorkerCounters::TASKS_EXECUTED, num_tasks);
+        // 最后一个任务完成：执行过任务的 worker 不会再为本次启动使用 arena，没有其他未完成启动的可以 reset，
+        // 然后唤醒调用 run() 的线程。置位 complete 之后不能再访问 launch，它属于调用 run() 的线程
+        if (launch->finished_tasks.fetch_add(num_tasks) + num_tasks == launch->num_total_tasks) {
+            counters.add(WorkerCounters::LAUNCHES_COMPLETED);
+            TaskTrace::instant(TaskTrace::LAUNCH_COMPLETE, launch->id, launch->num_total_tasks);
+            {
+                std::lock_guard<std::mutex> guard(this->arena_lock);
+                for (int i = 0; i < this->thread_num; i++) {
+                    if (launch->arena_users[i] && --this->arena_live_launches[i] == 0)
+                        this->arenas[i]->reset();
+                }
+            }
+            launch->complete.store(true);
+            this->waiter.notifyCaller();
         }
-        // unique_lock 自动解锁
     }
-    // 活着的 workers - 1，若减少后为0，则唤醒析构函数线程
-    this->alive_workers.fetch_sub(1, std::memory_order_relaxed);
-    if(this->alive_workers.load(std::memory_order_relaxed) == 0)  {
-        this->run_cv.notify_one();
+    counters.account(WorkerCounters::SPINNING_TICKS);
+}
+
+template <class QueuePolicy, class WaitPolicy, class PartitionPolicy>
+void ThreadPoolTaskSystem<QueuePolicy, WaitPolicy, PartitionPolicy>::run(IRunnable* runnable, int num_total_tasks) {
+    // 每次调用有自己的启动记录，多个线程可以同时调用 run()，共享同一组 workers
+    // NOTE: run() 要等待 worker 执行完毕才可返回
+    if (num_total_tasks <= 0)
+        return;
+    PoolLaunch launch(runnable, num_total_tasks, this->thread_num);
+    launch.id = this->next_launch_id++;
+    TaskTrace::instant(TaskTrace::LAUNCH_SUBMIT, launch.id, num_total_tasks);
+    TaskTrace::instant(TaskTrace::LAUNCH_READY, launch.id, num_total_tasks);
+    this->queue.template push<PartitionPolicy>(&launch);
+    this->waiter.notifyWorkers(num_total_tasks);
+    this->waiter.callerWait([&launch] { return launch.complete.load(); });
+}
+
+template <class QueuePolicy, class WaitPolicy, class PartitionPolicy>
+TaskID ThreadPoolTaskSystem<QueuePolicy, WaitPolicy, PartitionPolicy>::runAsyncWithDeps(
+        IRunnable* runnable, int num_total_tasks, const std::vector<TaskID>& deps) {
+    // You do not need to implement this method.
+    return 0;
+}
+
+template <class QueuePolicy, class WaitPolicy, class PartitionPolicy>
+void ThreadPoolTaskSystem<QueuePolicy, WaitPolicy, PartitionPolicy>::sync() {
+    // You do not need to implement this method.
+    return;
+}
+
+template <class QueuePolicy, class WaitPolicy, class PartitionPolicy>
+TaskArenaStats ThreadPoolTaskSystem<QueuePolicy, WaitPolicy, PartitionPolicy>::arenaStats() {
+    TaskArenaStats stats;
+    std::lock_guard<std::mutex> guard(this->arena_lock);
+    for (TaskArena* arena : this->arenas) {
+        if (arena) stats.add(arena->stats());
     }
+    return stats;
 }
 
-TaskSystemParallelThreadPoolSleeping::~TaskSystemParallelThreadPoolSleeping() {
-    //
-    // TODO: CS149 student implementations may decide to perform cleanup
-    // operations (such as thread pool shutdown construction) here.
-    // Implementations are free to add new class member variables
-    // (requiring changes to tasksys.h).
-    //
-    // 要退出，设置 stop 为 true 通知 worker 退出
-    this->stop.store(true, std::memory_order_relaxed);
-    // 使用条件变量睡眠，直到所有 workers 退出; 进入睡眠前，把所有 workers 唤醒
-    std::unique_lock<std::mutex> lock(this->run_lock);
-    this->run_cv.wait(lock, [this] { return this->alive_workers.load(std::memory_order_relaxed) == 0; });
-    // join 必须放在这里，因为线程池实现中，run() 会被调用很多遍，而构造函数和析构函数可能只会被调用一遍
+template <class QueuePolicy, class WaitPolicy, class PartitionPolicy>
+WakeupStats ThreadPoolTaskSystem<QueuePolicy, WaitPolicy, PartitionPolicy>::wakeupStats() {
+    return this->waiter.stats();
+}
+
+template <class QueuePolicy, class WaitPolicy, class PartitionPolicy>
+TaskSystemStats ThreadPoolTaskSystem<QueuePolicy, WaitPolicy, PartitionPolicy>::stats() {
+    TaskSystemStats stats = ITaskSystem::stats();
     for (int i = 0; i < this->thread_num; i++) {
-        this->thread_pool[i].join();
+        stats.workers.push_back(this->counters[i].snapshot());
     }
-    // 销毁线程池
-    this->thread_num = -1;
-    delete[] this->thread_pool;
-    this->thread_pool = nullptr;
-    // 任务设置为空，任务数量设置为 0，正在工作的 workers = 0
-    this->runnable = nullptr;
-    this->num_total_tasks = 0;
-    this->finished_tasks_num = 0;
-    this->num_working_workers = 0;
+    return stats;
 }
 
-void TaskSystemParallelThreadPoolSleeping::run(IRunnable* runnable, int num_total_tasks) {
-    //
-    // TODO: CS149 students will modify the implementation of this
-    // method in Parts A and B.  The implementation provided below runs all
-    // tasks sequentially on the calling thread.
-    //
-    // 初始化并行任务所需参数，包括正在工作的workers数目，任务函数 runnable，任务总量
-    // NOTE: run() 要等待 worker 执行完毕才可返回
-    std::unique_lock<std::mutex> lock(this->run_lock);
-    this->num_total_tasks = num_total_tasks;
-    this->finished_tasks_num = 0;
-    this->num_working_workers = 0;
-    this->runnable = runnable;
-    // 等待 workers 完成任务
-    this->run_cv.wait(lock, [this] { return this->finished_tasks_num == this->num_total_tasks; });
-    // 重置任务设置为空，任务数量设置为 0，正在工作的 workers = 0
-    this->runnable = nullptr;
-    this->num_total_tasks = 0;
-    this->finished_tasks_num = 0;
-    this->num_working_workers = 0;
-    // unique_lock 会被自动释放
+// 显式实例化：tasksys.h 用 extern template 声明了这些组合，新的组合要同时加在两处
+template class ThreadPoolTaskSystem<MutexQueue, SpinWait, DynamicPartition>;
+template class ThreadPoolTaskSystem<MutexQueue, SleepWait, DynamicPartition>;
+template class ThreadPoolTaskSystem<LockFreeQueue, SpinWait, DynamicPartition>;
+template class ThreadPoolTaskSystem<LockFreeQueue, HybridWait, GuidedPartition>;
+template class ThreadPoolTaskSystem<WorkStealingQueue, SleepWait, StaticPartition>;
+template class ThreadPoolTaskSystem<WorkStealingQueue, HybridWait, GuidedPartition>;
+
+/*
+ * ================================================================
+ * Parallel Thread Pool Spinning Task System Implementation
+ * ================================================================
+ */
+
+const char* TaskSystemParallelThreadPoolSpinning::name() {
+    return "Parallel + Thread Pool + Spin";
 }
 
-TaskID TaskSystemParallelThreadPoolSleeping::runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
-                                                    const std::vector<TaskID>& deps) {
+// 您在步骤1中的实现会因为每次调用run()时创建线程而产生开销。当任务计算量较小时，这种开销尤为明显。
+// 此时，我们建议您转向"线程池"实现，即您的任务执行系统预先创建所有工作线程（例如在TaskSystem构造期间，
+// 或在首次调用run()时）。
 
+// 作为初始实现，我们建议您设计工作线程持续循环，始终检查是否有更多工作需要执行（线程进入while循环直到
+// 条件满足，这通常被称为"自旋"）。工作线程如何判断是否有工作需要做？这个属于任务动态分配
 
-    //
-    // TODO: CS149 students will implement this method in Part B.
-    //
+// 现在要确保run()实现所需的同步行为已非易事。您需要如何改变run()的实现来确定批量任务启动中的所有任务已完成？
 
-    return 0;
-}
+// 线程池、worker 循环和 run() 都在 ThreadPoolTaskSystem 中：互斥队列 + 自旋等待 + 每次领取一个任务
+TaskSystemParallelThreadPoolSpinning::TaskSystemParallelThreadPoolSpinning(int num_threads)
+  : ThreadPoolTaskSystem<MutexQueue, SpinWait, DynamicPartition>(num_threads) {}
 
-void TaskSystemParallelThreadPoolSleeping::sync() {
+TaskSystemParallelThreadPoolSpinning::~TaskSystemParallelThreadPoolSpinning() {}
 
-    //
-    // TODO: CS149 students will modify the implementation of this method in Part B.
-    //
+/*
+ * ================================================================
+ * Parallel Thread Pool Sleeping Task System Implementation
+ * ================================================================
+ */
 
-    return;
+const char* TaskSystemParallelThreadPoolSleeping::name() {
+    return "Parallel + Thread Pool + Sleep";
 }
+
+// 线程池、worker 循环和 run() 都在 ThreadPoolTaskSystem 中：互斥队列 + 睡眠等待 + 每次领取一个任务
+TaskSystemParallelThreadPoolSleeping::TaskSystemParallelThreadPoolSleeping(int num_threads)
+  : ThreadPoolTaskSystem<MutexQueue, SleepWait, DynamicPartition>(num_threads) {}
+
+TaskSystemParallelThreadPoolSleeping::~TaskSystemParallelThreadPoolSleeping() {}
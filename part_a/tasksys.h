@@ -2,11 +2,15 @@
 #define _TASKSYS_H
 
 #include "itasksys.h"
+#include "tasktrace.h"
 
 #include <thread>
 #include <mutex>
 #include <atomic>
 #include <condition_variable>
+#include <vector>
+#include <deque>
+#include <string>
 
 /*
  * TaskSystemSerial: This class is the student's implementation of a
@@ -42,43 +46,284 @@ class TaskSystemParallelSpawn: public ITaskSystem {
         static void runThread(IRunnable *runnable, int task_id_start, int task_num, int num_total_tasks); 
     private:
         int thread_num = -1;
-        std::thread *thread_pool = nullptr;
+        // 下一个启动的编号，只用于 trace (多个线程可以同时调用 run()，因此是原子变量)
+        std::atomic<int> next_launch_id;
 };
 
 /*
- * TaskSystemParallelThreadPoolSpinning: This class is the student's
- * implementation of a parallel task execution engine that uses a
- * thread pool. See definition of ITaskSystem in itasksys.h for
- * documentation of the ITaskSystem interface.
+ * PoolLaunch: bookkeeping of one bulk task launch submitted by run() to a
+ * ThreadPoolTaskSystem.  Every caller of run() owns its own record, so
+ * several application threads may call run() on the same task system at
+ * the same time; the workers claim its tasks through the queue policy.
+ */
+struct PoolLaunch {
+    // 启动编号，只用于 trace
+    int id;
+    // 本次启动的任务和任务总量
+    IRunnable* runnable;
+    int num_total_tasks;
+    // 下一个待领取的任务编号 (只有 MutexQueue 使用，由其锁保护)
+    int next_task;
+    // 已完成的任务量
+    std::atomic<int> finished_tasks;
+    // 最后一个任务完成、簿记结束后置位，之后 workers 不再访问本记录，run() 可以返回
+    std::atomic<bool> complete;
+    // 哪些 worker 执行过本次启动的任务 (即可能在其 arena 上分配过内存)，由 arena_lock 保护；
+    // 只有 worker i 写第 i 个元素，所以它可以在锁外读自己的元素
+    std::vector<char> arena_users;
+
+    PoolLaunch(IRunnable* runnable, int num_total_tasks, int num_threads)
+      : id(-1), runnable(runnable), num_total_tasks(num_total_tasks), next_task(0),
+        finished_tasks(0), complete(false), arena_users(num_threads, 0) {}
+};
+
+/*
+ * WorkItem: tasks begin .. end-1 of a launch, claimed by a worker at once.
+ */
+struct WorkItem {
+    PoolLaunch* launch;
+    int begin;
+    int end;
+};
+
+/*
+ * Partition policies of ThreadPoolTaskSystem: how many tasks a worker
+ * claims at a time, given the tasks of the launch not yet handed out.
+ *
+ *  - StaticPartition: one block of num_total_tasks / num_threads tasks
+ *    per worker.
+ *  - DynamicPartition: one task at a time.
+ *  - GuidedPartition: the remaining tasks divided by the number of
+ *    threads, so chunks shrink towards the end of the launch.
  */
-class TaskSystemParallelThreadPoolSpinning: public ITaskSystem {
+struct StaticPartition {
+    static const char* name();
+    static int chunkSize(int remaining, int num_total_tasks, int num_threads);
+};
+
+struct DynamicPartition {
+    static const char* name();
+    static int chunkSize(int remaining, int num_total_tasks, int num_threads);
+};
+
+struct GuidedPartition {
+    static const char* name();
+    static int chunkSize(int remaining, int num_total_tasks, int num_threads);
+};
+
+/*
+ * Queue policies of ThreadPoolTaskSystem: where submitted launches wait
+ * and how workers claim their tasks.  push<Partition>() submits a launch,
+ * pop<Partition>() claims the next WorkItem for worker `thread_id` and
+ * hasWork() tells a waiting worker whether a pop() may succeed.
+ *
+ *  - MutexQueue: a deque of launches behind one lock, workers claim from
+ *    the launch at its head.
+ *  - LockFreeQueue: a fixed number of launch slots, workers claim with a
+ *    compare-and-swap on the slot without taking a lock.
+ *  - WorkStealingQueue: the launch is cut into WorkItems up front, dealt
+ *    round-robin to per-worker deques; a worker takes the newest item of
+ *    its own deque and steals the oldest of another when it is empty.
+ */
+class MutexQueue {
     public:
-        TaskSystemParallelThreadPoolSpinning(int num_threads);
-        ~TaskSystemParallelThreadPoolSpinning();
+        MutexQueue(int num_threads);
+        static const char* name();
+        template <class Partition> void push(PoolLaunch* launch);
+        template <class Partition> bool pop(int thread_id, WorkItem& item, WorkerCounters& counters);
+        bool hasWork();
+    private:
+        int num_threads;
+        std::mutex lock;
+        // 仍有任务可领取的启动，从队首领取 (由 lock 保护)
+        std::deque<PoolLaunch*> launches;
+        // launches 的长度，供 hasWork() 在锁外读取
+        std::atomic<int> num_launches;
+};
+
+class LockFreeQueue {
+    public:
+        LockFreeQueue(int num_threads);
+        static const char* name();
+        template <class Partition> void push(PoolLaunch* launch);
+        template <class Partition> bool pop(int thread_id, WorkItem& item, WorkerCounters& counters);
+        bool hasWork();
+    private:
+        // 同时可领取任务的启动数上限，槽位全满时 push() 让出 CPU 等待
+        static const int NUM_SLOTS = 16;
+        static const unsigned long long CLOSED = 0xffffffffULL;
+        struct Slot {
+            // 高 32 位是代数，每次复用槽位加一；低 32 位是下一个待领取的任务编号，
+            // 发布新启动的过程中为 CLOSED
+            std::atomic<unsigned long long> claim;
+            std::atomic<PoolLaunch*> launch;
+            std::atomic<int> num_total_tasks;
+            // 槽位被占用：从 push() 开始，到最后一块任务被领取为止
+            std::atomic<bool> busy;
+        };
+        int num_threads;
+        Slot slots[NUM_SLOTS];
+        // 仍有任务可领取的槽位数
+        std::atomic<int> num_active;
+};
+
+class WorkStealingQueue {
+    public:
+        WorkStealingQueue(int num_threads);
+        ~WorkStealingQueue();
+        static const char* name();
+        template <class Partition> void push(PoolLaunch* launch);
+        template <class Partition> bool pop(int thread_id, WorkItem& item, WorkerCounters& counters);
+        bool hasWork();
+    private:
+        struct WorkerDeque {
+            std::mutex lock;
+            std::deque<WorkItem> items;
+        };
+        int num_threads;
+        // 每个 worker 一个 deque
+        WorkerDeque* deques;
+        // 下一次 push() 从哪个 deque 开始分发，让各次启动的第一块落在不同的 worker 上
+        std::atomic<int> next_deque;
+        // 所有 deque 中的 WorkItem 总数
+        std::atomic<int> num_items;
+};
+
+/*
+ * Wait policies of ThreadPoolTaskSystem: what idle workers and the
+ * callers of run() do while they wait.  workerWait() returns once
+ * `ready` holds, after notifyWorkers() or notifyAll(); callerWait()
+ * returns once `done` holds, after notifyCaller().
+ *
+ *  - SpinWait: poll, yielding the CPU between polls.
+ *  - SleepWait: sleep on condition variables.  Every worker has its own,
+ *    and a launch of n tasks wakes at most n of them, most recently
+ *    parked first since their caches are warmest.
+ *  - HybridWait: poll SPIN_POLLS times, then sleep as SleepWait.
+ */
+class SpinWait {
+    public:
+        SpinWait(int num_threads);
+        static const char* name();
+        template <class Pred> void workerWait(int thread_id, Pred ready, WorkerCounters& counters);
+        template <class Pred> void callerWait(Pred done);
+        void notifyWorkers(int count);
+        void notifyCaller();
+        void notifyAll();
+        WakeupStats stats();
+};
+
+class SleepWait {
+    public:
+        SleepWait(int num_threads);
+        ~SleepWait();
+        static const char* name();
+        template <class Pred> void workerWait(int thread_id, Pred ready, WorkerCounters& counters);
+        template <class Pred> void callerWait(Pred done);
+        void notifyWorkers(int count);
+        void notifyCaller();
+        void notifyAll();
+        WakeupStats stats();
+    private:
+        // 唤醒至多 count 个睡眠的 workers (需持有 lock)
+        void wake(int count);
+        int num_threads;
+        std::mutex lock;
+        // 调用 run() 的线程睡眠于此，直到自己的启动完成
+        std::condition_variable caller_cv;
+        // 每个 worker 有自己的 cv 和唤醒标记，只有被选中的 worker 才会醒来 (由 lock 保护)
+        std::condition_variable* worker_cvs;
+        std::vector<bool> worker_signaled;
+        // 正在睡眠的 workers，后进先出 (由 lock 保护)
+        std::vector<int> idle_workers;
+        // 唤醒计数 (由 lock 保护)
+        WakeupStats wakeup_stats;
+};
+
+class HybridWait: public SleepWait {
+    public:
+        HybridWait(int num_threads);
+        static const char* name();
+        template <class Pred> void workerWait(int thread_id, Pred ready, WorkerCounters& counters);
+        template <class Pred> void callerWait(Pred done);
+    private:
+        static const int SPIN_POLLS = 1000;
+};
+
+/*
+ * ThreadPoolTaskSystem: a thread pool assembled at compile time from a
+ * queue, a wait and a partition policy (see above).  The policies are
+ * template parameters rather than virtual calls, so each combination
+ * compiles to its own worker loop with the policy code inlined and no
+ * branches on the configuration.  Only asynchronous launches are left
+ * unimplemented, as in the other part A task systems.
+ *
+ * The member functions are defined in tasksys.cpp, so only the
+ * combinations explicitly instantiated there (listed below) can be used;
+ * tests/tasksysimpls.h registers them with runtasks and microbench.
+ */
+template <class QueuePolicy, class WaitPolicy, class PartitionPolicy>
+class ThreadPoolTaskSystem: public ITaskSystem {
+    public:
+        ThreadPoolTaskSystem(int num_threads);
+        ~ThreadPoolTaskSystem();
         const char* name();
         void run(IRunnable* runnable, int num_total_tasks);
         TaskID runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
                                 const std::vector<TaskID>& deps);
         void sync();
-        static void runThread(IRunnable *runnable, int task_id_start, int task_num, int num_total_tasks); 
-        void worker(int thread_id); 
+        TaskArenaStats arenaStats();
+        WakeupStats wakeupStats();
+        TaskSystemStats stats();
     private:
+        void worker(int thread_id);
+        // "Thread Pool: <queue> + <wait> + <partition>"
+        std::string pool_name;
         // 总线程数 (构造函数设置好，无需锁)
         int thread_num;
         // 线程池指针 (构造函数设置好，无需锁)
         std::thread *thread_pool;
-        // 当前要执行的任务 (共享变量，但写稀少，读多次，一般不加同步)
-        IRunnable *runnable;
-        // 任务总量 (共享变量，但写稀少，读多次，一般不加同步)
-        int num_total_tasks;
-        // 正在工作的 workers
-        int num_working_workers;
-        // 已完成的任务量，这里使用 finished_tasks_num 而非 cur_task_id 的原因是：cur_task_id 无法表述已完成的任务数，在并行场景下无法让 run 判断何时该返回
-        int finished_tasks_num;
-        // 同步锁
-        std::mutex compare_lock;
-        // 表示是否要销毁线程，用于通知 worker 退出 (共享变量，但写两次，读多次，一般不用加同步)
-        bool stop;
+        QueuePolicy queue;
+        WaitPolicy waiter;
+        // 下一个启动的编号，只用于 trace
+        std::atomic<int> next_launch_id;
+        // 表示是否要销毁线程，用于通知 worker 退出
+        std::atomic<bool> stop;
+        // 每个 worker 的 TaskArena，worker 启动时登记，以及执行过任务、尚未完成的启动数；
+        // 计数归零时该 worker 没有在执行任务，可以安全地 reset (由 arena_lock 保护)
+        std::mutex arena_lock;
+        std::vector<TaskArena*> arenas;
+        std::vector<int> arena_live_launches;
+        // 每个 worker 自己的计数器，只有该 worker 写入，不需要锁
+        WorkerCounters* counters;
+};
+
+extern template class ThreadPoolTaskSystem<MutexQueue, SpinWait, DynamicPartition>;
+extern template class ThreadPoolTaskSystem<MutexQueue, SleepWait, DynamicPartition>;
+extern template class ThreadPoolTaskSystem<LockFreeQueue, SpinWait, DynamicPartition>;
+extern template class ThreadPoolTaskSystem<LockFreeQueue, HybridWait, GuidedPartition>;
+extern template class ThreadPoolTaskSystem<WorkStealingQueue, SleepWait, StaticPartition>;
+extern template class ThreadPoolTaskSystem<WorkStealingQueue, HybridWait, GuidedPartition>;
+
+// tests/tasksysimpls.h registers the policy combinations above with
+// runtasks and microbench when this is defined
+#define TASKSYS_POLICY_POOLS
+
+/*
+ * TaskSystemParallelThreadPoolSpinning: This class is the student's
+ * implementation of a parallel task execution engine that uses a
+ * thread pool. See definition of ITaskSystem in itasksys.h for
+ * documentation of the ITaskSystem interface.
+ *
+ * Workers claim one task at a time from a locked queue and spin while
+ * there is none.
+ */
+class TaskSystemParallelThreadPoolSpinning
+  : public ThreadPoolTaskSystem<MutexQueue, SpinWait, DynamicPartition> {
+    public:
+        TaskSystemParallelThreadPoolSpinning(int num_threads);
+        ~TaskSystemParallelThreadPoolSpinning();
+        const char* name();
 };
 
 /*
@@ -86,40 +331,16 @@ class TaskSystemParallelThreadPoolSpinning: public ITaskSystem {
  * optimized implementation of a parallel task execution engine that uses
  * a thread pool. See definition of ITaskSystem in
  * itasksys.h for documentation of the ITaskSystem interface.
+ *
+ * Workers claim one task at a time from a locked queue and sleep while
+ * there is none.
  */
-class TaskSystemParallelThreadPoolSleeping: public ITaskSystem {
+class TaskSystemParallelThreadPoolSleeping
+  : public ThreadPoolTaskSystem<MutexQueue, SleepWait, DynamicPartition> {
     public:
         TaskSystemParallelThreadPoolSleeping(int num_threads);
         ~TaskSystemParallelThreadPoolSleeping();
         const char* name();
-        void run(IRunnable* runnable, int num_total_tasks);
-        TaskID runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
-                                const std::vector<TaskID>& deps);
-        void sync();
-        static void runThread(IRunnable *runnable, int task_id_start, int task_num, int num_total_tasks); 
-        void worker(int thread_id); 
-    private:
-        // 总线程数 (构造函数设置好，无需锁)
-        int thread_num;
-        // 线程池指针 (构造函数设置好，无需锁)
-        std::thread *thread_pool;
-        // 当前要执行的任务 (共享变量，但写稀少，读多次，一般不加同步)
-        IRunnable *runnable;
-        // 任务总量 (共享变量，但写稀少，读多次，一般不加同步)
-        int num_total_tasks;
-        // 正在工作的 workers
-        int num_working_workers;
-        // 已完成的任务量，这里使用 finished_tasks_num 而非 cur_task_id 的原因是：cur_task_id 无法表述已完成的任务数，在并行场景下无法让 run 判断何时该返回
-        int finished_tasks_num;
-        // 表示是否要销毁线程，用于通知 worker 退出 (共享变量，但写两次，读多次，一般不用加同步)
-        std::atomic<bool> stop;
-        // 活着的 worker 数量，供析构函数决定什么时候解除睡眠
-        std::atomic<int> alive_workers; 
-        // run_cv 调用 run() 的线程在给所有 workers 分配任务后要进入睡眠，因此需要 cv
-        // + workers 也可以使用 run_cv 进入睡眠状态
-        std::condition_variable run_cv;
-        // run_lock 适配 run_cv 的互斥锁
-        std::mutex run_lock;
 };
 
 #endif
@@ -1,9 +1,114 @@
 #ifndef _ITASKSYS_H
 #define _ITASKSYS_H
 #include <vector>
+#include <functional>
+
+#include "taskarena.h"
+#include "workerstats.h"
 
 typedef int TaskID;
 
+class IRunnable;
+class LaunchHandle;
+
+/*
+ * TaskDep: a dependency of a bulk task launch on an earlier bulk task
+ * launch `launch`, refined to the task level.  The mapping decides which
+ * tasks of `launch` each task of the dependent launch waits for:
+ *
+ *  - ALL: every task waits for all tasks of `launch` (same as passing
+ *    `launch` in the deps vector of runAsyncWithDeps()).
+ *  - IDENTITY: task i waits for task i of `launch`.
+ *  - WINDOW: task i waits for tasks i-radius .. i+radius of `launch`.
+ *  - CUSTOM: task i waits for the tasks `custom` writes into `dep_task_ids`.
+ *
+ * Task ids outside 0 .. num_total_tasks-1 of `launch` are ignored.
+ */
+struct TaskDep {
+    enum Mapping { ALL, IDENTITY, WINDOW, CUSTOM };
+
+    TaskID launch;
+    Mapping mapping;
+    int radius;
+    std::function<void(int task_id, std::vector<int>& dep_task_ids)> custom;
+
+    static TaskDep all(TaskID launch) {
+        TaskDep dep = { launch, ALL, 0, nullptr };
+        return dep;
+    }
+    static TaskDep identity(TaskID launch) {
+        TaskDep dep = { launch, IDENTITY, 0, nullptr };
+        return dep;
+    }
+    static TaskDep window(TaskID launch, int radius) {
+        TaskDep dep = { launch, WINDOW, radius, nullptr };
+        return dep;
+    }
+    static TaskDep mapped(TaskID launch,
+                          const std::function<void(int, std::vector<int>&)>& custom) {
+        TaskDep dep = { launch, CUSTOM, 0, custom };
+        return dep;
+    }
+};
+
+/*
+ * LaunchDesc: one bulk task launch of a batch passed to
+ * ITaskSystem::submitBatch().  `deps` holds TaskIDs of launches submitted
+ * before the batch; `batch_deps` holds indices of earlier entries of the
+ * same batch (each must be smaller than this entry's own index).
+ */
+struct LaunchDesc {
+    IRunnable* runnable;
+    int num_total_tasks;
+    std::vector<TaskID> deps;
+    std::vector<int> batch_deps;
+};
+
+/*
+ * Counters of dependency edges a task system dropped at submission time
+ * instead of registering them.
+ */
+struct DepPruningStats {
+    // deps on launches that had already completed
+    long long completed;
+    // deps listed more than once for the same launch
+    long long duplicate;
+    // deps implied by another dep of the same launch (see
+    // ITaskSystem::setDepPruningWindow())
+    long long transitive;
+    // deps that were registered
+    long long kept;
+
+    DepPruningStats(): completed(0), duplicate(0), transitive(0), kept(0) {}
+};
+
+/*
+ * Counters of how a task system woke its sleeping worker threads.
+ */
+struct WakeupStats {
+    // bulk task launches whose tasks were handed to the workers
+    long long launches;
+    // times a sleeping worker was woken
+    long long wakeups;
+    // wake-ups after which the worker found no work and slept again
+    long long spurious_wakeups;
+
+    WakeupStats(): launches(0), wakeups(0), spurious_wakeups(0) {}
+};
+
+/*
+ * Snapshot of a task system's performance counters: one WorkerStats per
+ * worker thread (empty for task systems without a persistent pool),
+ * followed by the system-wide counters also returned by arenaStats(),
+ * depPruningStats() and wakeupStats().
+ */
+struct TaskSystemStats {
+    std::vector<WorkerStats> workers;
+    TaskArenaStats arena;
+    DepPruningStats dep_pruning;
+    WakeupStats wakeup;
+};
+
 class IRunnable {
     public:
         virtual ~IRunnable();
@@ -66,5 +171,163 @@ class ITaskSystem {
           runXXX calls are done.
          */
         virtual void sync() = 0;
+
+        /*
+          Same as runAsyncWithDeps(), but with task-level dependencies:
+          a task of this bulk task launch may begin as soon as the tasks
+          it depends on (see TaskDep) are complete, rather than waiting
+          for the whole of each launch in `deps`.
+
+          The default implementation treats every TaskDep as ALL.
+         */
+        virtual TaskID runAsyncWithTaskDeps(IRunnable* runnable, int num_total_tasks,
+                                            const std::vector<TaskDep>& deps);
+
+        /*
+          Submits `count` asynchronous bulk task launches at once, as if
+          runAsyncWithDeps() were called on each entry of `descs` in
+          order, and writes their TaskIDs to `out_ids`.  Submitting a
+          whole graph in one call lets the task system take its locks
+          and wake its workers once per batch rather than once per
+          launch.
+
+          The default implementation calls runAsyncWithDeps() for each
+          entry.
+         */
+        virtual void submitBatch(const LaunchDesc* descs, int count, TaskID* out_ids);
+
+        /*
+          Creates a user event: a TaskID that completes when signal()
+          is called on it rather than when tasks finish.  It can be used
+          anywhere a TaskID is accepted as a dependency, so launches can
+          wait on work outside the task system without the caller
+          blocking.  sync() does not return until every event created
+          has been signaled.
+
+          The default implementation returns an event that is treated
+          as already signaled.
+         */
+        virtual TaskID createEvent();
+
+        /*
+          Signals the user event `event`, releasing launches that depend
+          on it.  May be called from any thread.  Signaling an event
+          more than once has no further effect.
+         */
+        virtual void signal(TaskID event);
+
+        /*
+          Returns the combined usage of the TaskArenas of the threads
+          this task system runs tasks on.  Tasks allocate scratch memory
+          with TaskArena::current()->allocate(); see taskarena.h.  Should
+          be called while no launches are in flight.
+
+          The default implementation reports the arena of the calling
+          thread.
+         */
+        virtual TaskArenaStats arenaStats();
+
+        /*
+          Enables transitive reduction of launch-level dependencies at
+          submission time: a dep on launch A is dropped when another dep
+          B of the same launch itself depends directly on A.  `window`
+          bounds the work per launch: at most `window` deps are
+          examined, and at most `window` of each one's own deps.  0
+          (the default) disables the reduction.  Completed and duplicate
+          deps are pruned regardless.
+
+          The default implementation ignores the setting.
+         */
+        virtual void setDepPruningWindow(int window);
+
+        /*
+          Returns how many dependency edges were pruned at submission
+          time since the task system was created.
+
+          The default implementation reports no pruning.
+         */
+        virtual DepPruningStats depPruningStats();
+
+        /*
+          Returns how often worker threads were woken since the task
+          system was created.
+
+          The default implementation reports no wake-ups.
+         */
+        virtual WakeupStats wakeupStats();
+
+        /*
+          Returns a snapshot of the task system's counters since it was
+          created.  Like arenaStats(), should be called while no
+          launches are in flight.
+
+          The default implementation reports no workers and fills in the
+          system-wide counters from the methods above.
+         */
+        virtual TaskSystemStats stats();
+
+        /*
+          Returns true if, once warmed up by earlier launches of the same
+          shape, the task system submits and runs asynchronous launches
+          without allocating from the heap.  Tests that count
+          allocations fail such a task system if it allocates.
+
+          The default implementation returns false.
+         */
+        virtual bool allocationFreeLaunches();
+
+        /*
+          Same as runAsyncWithDeps(), but returns a LaunchHandle that
+          can be used to attach continuations to the bulk task launch.
+         */
+        LaunchHandle launch(IRunnable* runnable, int num_total_tasks,
+                            const std::vector<TaskID>& deps);
+
+        /*
+          Registers `continuation` to run once all tasks of the bulk
+          task launch `task_id` are complete.  Implementations that
+          execute launches on worker threads run the continuation on
+          the worker that finished the last task of the launch.  If the
+          launch has already completed, the continuation runs
+          immediately on the calling thread.
+
+          sync() does not return until all continuations registered on
+          prior launches have returned.
+
+          The default implementation blocks in sync() and then runs the
+          continuation on the calling thread.
+         */
+        virtual void then(TaskID task_id, const std::function<void()>& continuation);
 };
+
+/*
+ * LaunchHandle: a lightweight, copyable handle to a bulk task launch
+ * returned by ITaskSystem::launch().  It converts to the launch's
+ * TaskID so it can be pushed into the `deps` vector of later launches.
+ */
+class LaunchHandle {
+    public:
+        LaunchHandle(ITaskSystem* system, TaskID id): system_(system), id_(id) {}
+
+        TaskID id() const { return id_; }
+        operator TaskID() const { return id_; }
+
+        /*
+          Registers a continuation on this launch.  See
+          ITaskSystem::then().
+         */
+        const LaunchHandle& then(const std::function<void()>& continuation) const {
+            system_->then(id_, continuation);
+            return *this;
+        }
+
+    private:
+        ITaskSystem* system_;
+        TaskID id_;
+};
+
+inline LaunchHandle ITaskSystem::launch(IRunnable* runnable, int num_total_tasks,
+                                        const std::vector<TaskID>& deps) {
+    return LaunchHandle(this, runAsyncWithDeps(runnable, num_total_tasks, deps));
+}
 #endif
@@ -6,6 +6,139 @@ IRunnable::~IRunnable() {}
 ITaskSystem::ITaskSystem(int num_threads) {}
 ITaskSystem::~ITaskSystem() {}
 
+TaskID ITaskSystem::runAsyncWithTaskDeps(IRunnable* runnable, int num_total_tasks,
+                                         const std::vector<TaskDep>& deps) {
+    std::vector<TaskID> launch_deps;
+    for (const TaskDep& dep : deps) {
+        launch_deps.push_back(dep.launch);
+    }
+    return runAsyncWithDeps(runnable, num_total_tasks, launch_deps);
+}
+
+void ITaskSystem::submitBatch(const LaunchDesc* descs, int count, TaskID* out_ids) {
+    std::vector<TaskID> deps;
+    for (int i = 0; i < count; i++) {
+        deps = descs[i].deps;
+        for (int idx : descs[i].batch_deps) {
+            deps.push_back(out_ids[idx]);
+        }
+        out_ids[i] = runAsyncWithDeps(descs[i].runnable, descs[i].num_total_tasks, deps);
+    }
+}
+
+TaskID ITaskSystem::createEvent() {
+    return -1;
+}
+
+void ITaskSystem::signal(TaskID event) {}
+
+TaskArenaStats ITaskSystem::arenaStats() {
+    return TaskArena::current()->stats();
+}
+
+void ITaskSystem::setDepPruningWindow(int window) {}
+
+DepPruningStats ITaskSystem::depPruningStats() {
+    return DepPruningStats();
+}
+
+WakeupStats ITaskSystem::wakeupStats() {
+    return WakeupStats();
+}
+
+bool ITaskSystem::allocationFreeLaunches() {
+    return false;
+}
+
+TaskSystemStats ITaskSystem::stats() {
+    TaskSystemStats stats;
+    stats.arena = arenaStats();
+    stats.dep_pruning = depPruningStats();
+    stats.wakeup = wakeupStats();
+    return stats;
+}
+
+void ITaskSystem::then(TaskID task_id, const std::function<void()>& continuation) {
+    sync();
+    continuation();
+}
+
+/*
+ * ================================================================
+ * Deferred launches for synchronous task systems
+ * ================================================================
+ */
+
+DeferredLaunches::DeferredLaunches() {
+    this->next_task_id = 0;
+}
+
+bool DeferredLaunches::blocked(const std::vector<TaskID>& deps) {
+    for (TaskID dep : deps) {
+        if (this->incomplete.count(dep)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+TaskID DeferredLaunches::launch(ITaskSystem* system, IRunnable* runnable, int num_total_tasks,
+                                const std::vector<TaskID>& deps) {
+    std::unique_lock<std::mutex> lock(this->lock);
+    TaskID id = this->next_task_id++;
+    if (blocked(deps)) {
+        Deferred d = { id, runnable, num_total_tasks, deps };
+        this->deferred.push_back(d);
+        this->incomplete.insert(id);
+        return id;
+    }
+    lock.unlock();
+    system->run(runnable, num_total_tasks);
+    return id;
+}
+
+TaskID DeferredLaunches::createEvent() {
+    std::lock_guard<std::mutex> lock(this->lock);
+    TaskID id = this->next_task_id++;
+    this->events.insert(id);
+    this->incomplete.insert(id);
+    return id;
+}
+
+void DeferredLaunches::signal(ITaskSystem* system, TaskID event) {
+    std::unique_lock<std::mutex> lock(this->lock);
+    if (this->events.erase(event) == 0) {
+        return;
+    }
+    this->incomplete.erase(event);
+    // 反复执行依赖已满足的被推迟启动，直到没有可执行的为止
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (size_t i = 0; i < this->deferred.size(); i++) {
+            if (blocked(this->deferred[i].deps)) {
+                continue;
+            }
+            Deferred d = this->deferred[i];
+            this->deferred.erase(this->deferred.begin() + i);
+            lock.unlock();
+            system->run(d.runnable, d.num_total_tasks);
+            lock.lock();
+            this->incomplete.erase(d.id);
+            progress = true;
+            break;
+        }
+    }
+    if (this->incomplete.empty()) {
+        this->sync_cv.notify_all();
+    }
+}
+
+void DeferredLaunches::sync() {
+    std::unique_lock<std::mutex> lock(this->lock);
+    this->sync_cv.wait(lock, [this] { return this->incomplete.empty(); });
+}
+
 /*
  * ================================================================
  * Serial task system implementation
@@ -25,19 +158,24 @@ void TaskSystemSerial::run(IRunnable* runnable, int num_total_tasks) {
     for (int i = 0; i < num_total_tasks; i++) {
         runnable->runTask(i, num_total_tasks);
     }
+    TaskArena::current()->reset();
 }
 
 TaskID TaskSystemSerial::runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
                                           const std::vector<TaskID>& deps) {
-    for (int i = 0; i < num_total_tasks; i++) {
-        runnable->runTask(i, num_total_tasks);
-    }
-
-    return 0;
+    return this->deferred.launch(this, runnable, num_total_tasks, deps);
 }
 
 void TaskSystemSerial::sync() {
-    return;
+    this->deferred.sync();
+}
+
+TaskID TaskSystemSerial::createEvent() {
+    return this->deferred.createEvent();
+}
+
+void TaskSystemSerial::signal(TaskID event) {
+    this->deferred.signal(this, event);
 }
 
 /*
@@ -61,21 +199,26 @@ void TaskSystemParallelSpawn::run(IRunnable* runnable, int num_total_tasks) {
     for (int i = 0; i < num_total_tasks; i++) {
         runnable->runTask(i, num_total_tasks);
     }
+    TaskArena::current()->reset();
 }
 
 TaskID TaskSystemParallelSpawn::runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
                                                  const std::vector<TaskID>& deps) {
     // NOTE: CS149 students are not expected to implement TaskSystemParallelSpawn in Part B.
-    for (int i = 0; i < num_total_tasks; i++) {
-        runnable->runTask(i, num_total_tasks);
-    }
-
-    return 0;
+    return this->deferred.launch(this, runnable, num_total_tasks, deps);
 }
 
 void TaskSystemParallelSpawn::sync() {
     // NOTE: CS149 students are not expected to implement TaskSystemParallelSpawn in Part B.
-    return;
+    this->deferred.sync();
+}
+
+TaskID TaskSystemParallelSpawn::createEvent() {
+    return this->deferred.createEvent();
+}
+
+void TaskSystemParallelSpawn::signal(TaskID event) {
+    this->deferred.signal(this, event);
 }
 
 /*
@@ -99,21 +242,26 @@ void TaskSystemParallelThreadPoolSpinning::run(IRunnable* runnable, int num_tota
     for (int i = 0; i < num_total_tasks; i++) {
         runnable->runTask(i, num_total_tasks);
     }
+    TaskArena::current()->reset();
 }
 
 TaskID TaskSystemParallelThreadPoolSpinning::runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
                                                               const std::vector<TaskID>& deps) {
     // NOTE: CS149 students are not expected to implement TaskSystemParallelThreadPoolSpinning in Part B.
-    for (int i = 0; i < num_total_tasks; i++) {
-        runnable->runTask(i, num_total_tasks);
-    }
-
-    return 0;
+    return this->deferred.launch(this, runnable, num_total_tasks, deps);
 }
 
 void TaskSystemParallelThreadPoolSpinning::sync() {
     // NOTE: CS149 students are not expected to implement TaskSystemParallelThreadPoolSpinning in Part B.
-    return;
+    this->deferred.sync();
+}
+
+TaskID TaskSystemParallelThreadPoolSpinning::createEvent() {
+    return this->deferred.createEvent();
+}
+
+void TaskSystemParallelThreadPoolSpinning::signal(TaskID event) {
+    this->deferred.signal(this, event);
 }
 
 /*
@@ -126,58 +274,765 @@ const char* TaskSystemParallelThreadPoolSleeping::name() {
     return "Parallel + Thread Pool + Sleep";
 }
 
-TaskSystemParallelThreadPoolSleeping::TaskSystemParallelThreadPoolSleeping(int num_threads): ITaskSystem(num_threads) {
-    //
-    // TODO: CS149 student implementations may decide to perform setup
-    // operations (such as thread pool construction) here.
-    // Implementations are free to add new class member variables
-    // (requiring changes to tasksys.h).
-    //
+TaskSystemParallelThreadPoolSleeping::TaskSystemParallelThreadPoolSleeping(int num_threads)
+    : ITaskSystem(num_threads), work_queue(4096) {
+    // NOTE: 除了线程以外的成员变量必须在创建线程池之前初始化，否则 worker 可能会使用随机初始值执行一些指令
+    this->thread_num = num_threads;
+    this->next_task_id = 0;
+    this->launch_table.assign(64, LaunchSlot());
+    this->launch_table_used = 0;
+    this->dep_stamp = 0;
+    this->dep_pruning_window = 0;
+    this->arenas.assign(this->thread_num, nullptr);
+    this->overflow_size = 0;
+    this->queued_items = 0;
+    this->retired = nullptr;
+    this->unfinished_launches = 0;
+    this->arena_refs = new std::atomic<int>[this->thread_num];
+    for (int i = 0; i < this->thread_num; i++) {
+        this->arena_refs[i] = 0;
+    }
+    this->slots = new ParkingSlot[this->thread_num];
+    for (int i = 0; i < this->thread_num; i++) {
+        this->slots[i].signaled = false;
+    }
+    this->idle_workers.reserve(this->thread_num);
+    this->idle_count = 0;
+    this->stop = false;
+    this->num_ready_launches = 0;
+    this->num_wakeups = 0;
+    this->num_spurious_wakeups = 0;
+    this->counters = new WorkerCounters[this->thread_num];
+    this->thread_pool = new std::thread[this->thread_num];
+    for (int i = 0; i < this->thread_num; i++) {
+        this->thread_pool[i] = std::thread([this, i]() {
+            worker(i);
+        });
+    }
 }
 
 TaskSystemParallelThreadPoolSleeping::~TaskSystemParallelThreadPoolSleeping() {
-    //
-    // TODO: CS149 student implementations may decide to perform cleanup
-    // operations (such as thread pool shutdown construction) here.
-    // Implementations are free to add new class member variables
-    // (requiring changes to tasksys.h).
-    //
+    // 先等待所有已提交的启动完成，再通知 workers 退出
+    sync();
+    {
+        std::lock_guard<std::mutex> lock(this->idle_lock);
+        this->stop = true;
+    }
+    for (int i = 0; i < this->thread_num; i++) {
+        std::lock_guard<std::mutex> lock(this->slots[i].lock);
+        this->slots[i].signaled = true;
+        this->slots[i].cv.notify_one();
+    }
+    for (int i = 0; i < this->thread_num; i++) {
+        this->thread_pool[i].join();
+    }
+    delete[] this->thread_pool;
+    this->thread_pool = nullptr;
+    this->thread_num = -1;
+    // workers 都已退出，所有启动记录都在 retired 或池中
+    reclaimRetired();
+    for (Launch* launch : this->free_launches) {
+        delete launch;
+    }
+    for (SuccessorBlock* block : this->free_blocks) {
+        delete block;
+    }
+    delete[] this->arena_refs;
+    delete[] this->slots;
+    delete[] this->counters;
 }
 
-void TaskSystemParallelThreadPoolSleeping::run(IRunnable* runnable, int num_total_tasks) {
+void TaskSystemParallelThreadPoolSleeping::worker(int thread_id) {
+    {
+        std::lock_guard<std::mutex> lock(this->submit_lock);
+        this->arenas[thread_id] = TaskArena::current();
+    }
+    WorkerCounters& counters = this->counters[thread_id];
+    counters.start();
+    WorkItem item;
+    bool woken = false;
+    while (true) {
+        if (popWork(item)) {
+            woken = false;
+            counters.add(WorkerCounters::CHUNKS_CLAIMED);
+            Launch* launch = item.launch;
+            if (item.task_id >= 0) {
+                runTask(launch, item.task_id, thread_id);
+            } else {
+                // 持有令牌：不断领取任务直到领完，然后归还令牌
+                int num_total_tasks = launch->num_total_tasks;
+                while (true) {
+                    int task_id = launch->next_task.fetch_add(1);
+                    if (task_id >= num_total_tasks) {
+                        break;
+                    }
+                    runTask(launch, task_id, thread_id);
+                }
+                dropRef(launch);
+            }
+            continue;
+        }
+        // 被唤醒却没有拿到工作
+        if (woken) {
+            this->num_spurious_wakeups++;
+        }
+        if (!park(thread_id)) {
+            break;
+        }
+        woken = true;
+    }
+    counters.account(WorkerCounters::SPINNING_TICKS);
+}
 
+bool TaskSystemParallelThreadPoolSleeping::park(int thread_id) {
+    ParkingSlot& slot = this->slots[thread_id];
+    {
+        std::lock_guard<std::mutex> lock(this->idle_lock);
+        if (this->stop) {
+            return false;
+        }
+        this->idle_workers.push_back(thread_id);
+        this->idle_count++;
+    }
+    // 登记之后再检查一次 queued_items：入队方先增加 queued_items 再检查 idle_count，
+    // 两边至少有一方能看到对方，不会丢失唤醒
+    if (this->queued_items.load() > 0) {
+        std::lock_guard<std::mutex> lock(this->idle_lock);
+        std::vector<int>::iterator it = std::find(this->idle_workers.begin(), this->idle_workers.end(), thread_id);
+        if (it != this->idle_workers.end()) {
+            // 还没有被选中唤醒，撤销登记
+            this->idle_workers.erase(it);
+            this->idle_count--;
+            return true;
+        }
+        // 已经被选中唤醒，下面的 wait 会立即返回
+    }
+    WorkerCounters& counters = this->counters[thread_id];
+    counters.account(WorkerCounters::SPINNING_TICKS);
+    CycleTimer::SysClock begin = TaskTrace::now();
+    std::unique_lock<std::mutex> lock(slot.lock);
+    slot.cv.wait(lock, [&] { return slot.signaled; });
+    slot.signaled = false;
+    TaskTrace::span(TaskTrace::PARK, begin);
+    counters.account(WorkerCounters::PARKED_TICKS);
+    counters.add(WorkerCounters::WAKEUPS);
+    return true;
+}
 
-    //
-    // TODO: CS149 students will modify the implementation of this
-    // method in Parts A and B.  The implementation provided below runs all
-    // tasks sequentially on the calling thread.
-    //
+void TaskSystemParallelThreadPoolSleeping::wakeWorkers(int count) {
+    if (count <= 0 || this->idle_count.load() == 0) {
+        return;
+    }
+    // 只唤醒 min(count, 睡眠的 worker 数) 个 worker，每个都在自己的停车位上单独唤醒
+    std::lock_guard<std::mutex> lock(this->idle_lock);
+    int num_woken = 0;
+    while (num_woken < count && !this->idle_workers.empty()) {
+        ParkingSlot& slot = this->slots[this->idle_workers.back()];
+        this->idle_workers.pop_back();
+        this->idle_count--;
+        {
+            std::lock_guard<std::mutex> slot_lock(slot.lock);
+            slot.signaled = true;
+        }
+        slot.cv.notify_one();
+        num_woken++;
+    }
+    this->num_wakeups += num_woken;
+}
 
-    for (int i = 0; i < num_total_tasks; i++) {
-        runnable->runTask(i, num_total_tasks);
+void TaskSystemParallelThreadPoolSleeping::runTask(Launch* launch, int task_id, int thread_id) {
+    if (!launch->arena_users[thread_id]) {
+        launch->arena_users[thread_id] = 1;
+        acquireArena(thread_id);
+    }
+    // 领取任务之前 (包括找工作和调度开销) 的时间记为 spinning
+    WorkerCounters& counters = this->counters[thread_id];
+    counters.account(WorkerCounters::SPINNING_TICKS);
+    CycleTimer::SysClock begin = TaskTrace::now();
+    launch->runnable->runTask(task_id, launch->num_total_tasks);
+    TaskTrace::span(TaskTrace::TASK, begin, launch->id, task_id, 1);
+    counters.account(WorkerCounters::BUSY_TICKS);
+    counters.add(WorkerCounters::TASKS_EXECUTED);
+    // 先标记任务完成再检查 has_task_successors，登记任务级依赖时顺序相反，
+    // 两边至少有一方能看到对方，保证每个登记的后继都恰好被释放一次
+    launch->task_finished[task_id].store(true);
+    if (launch->has_task_successors.load()) {
+        std::lock_guard<std::mutex> lock(launch->lock);
+        for (const TaskRef& ref : launch->task_successors[task_id]) {
+            if (ref.launch->task_pending[ref.task_id].fetch_sub(1) == 1) {
+                pushWork(ref.launch, ref.task_id);
+                wakeWorkers(1);
+            }
+        }
+    }
+    if (launch->finished_tasks.fetch_add(1) + 1 == launch->num_total_tasks) {
+        counters.add(WorkerCounters::LAUNCHES_COMPLETED);
+        finishLaunch(launch);
     }
 }
 
-TaskID TaskSystemParallelThreadPoolSleeping::runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
-                                                    const std::vector<TaskID>& deps) {
+void TaskSystemParallelThreadPoolSleeping::pushWork(Launch* launch, int task_id) {
+    WorkItem item = { launch, task_id };
+    if (!this->work_queue.push(item)) {
+        std::lock_guard<std::mutex> lock(this->overflow_lock);
+        this->overflow.push_back(item);
+        this->overflow_size++;
+    }
+    this->queued_items.fetch_add(1);
+}
 
+bool TaskSystemParallelThreadPoolSleeping::popWork(WorkItem& item) {
+    if (!this->work_queue.pop(item)) {
+        if (this->overflow_size.load() == 0) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(this->overflow_lock);
+        if (this->overflow.empty()) {
+            return false;
+        }
+        item = this->overflow.back();
+        this->overflow.pop_back();
+        this->overflow_size--;
+    }
+    this->queued_items.fetch_sub(1);
+    return true;
+}
+
+void TaskSystemParallelThreadPoolSleeping::acquireArena(int thread_id) {
+    std::atomic<int>& refs = this->arena_refs[thread_id];
+    int count = refs.load();
+    while (true) {
+        // 其他线程正在 reset 该 arena，等待 reset 完成
+        if (count < 0) {
+            count = refs.load();
+            continue;
+        }
+        if (refs.compare_exchange_weak(count, count + 1)) {
+            return;
+        }
+    }
+}
+
+void TaskSystemParallelThreadPoolSleeping::releaseArena(int thread_id) {
+    std::atomic<int>& refs = this->arena_refs[thread_id];
+    if (refs.fetch_sub(1) != 1) {
+        return;
+    }
+    // 计数归零说明该 worker 没有在执行可能使用 arena 的任务；置为 -1 期间 worker 不会开始新的任务。
+    // CAS 失败说明 worker 已经开始了新的启动，由那个启动完成时再 reset
+    int expected = 0;
+    if (refs.compare_exchange_strong(expected, -1)) {
+        this->arenas[thread_id]->reset();
+        refs.store(0);
+    }
+}
+
+int TaskSystemParallelThreadPoolSleeping::readyLaunch(Launch* launch, bool wake) {
+    int num_total_tasks = launch->num_total_tasks;
+    if (num_total_tasks <= 0) {
+        finishLaunch(launch);
+        return 0;
+    }
+    TaskTrace::instant(TaskTrace::LAUNCH_READY, launch->id, num_total_tasks);
+    this->num_ready_launches++;
+    if (launch->task_level) {
+        // 启动级依赖已满足：释放每个任务的守卫，前驱任务也都已完成的任务立即就绪。
+        // 遍历期间持有一个引用，防止启动在遍历结束前完成并被回收
+        launch->refs.fetch_add(1);
+        int num_ready = 0;
+        for (int i = 0; i < num_total_tasks; i++) {
+            if (launch->task_pending[i].fetch_sub(1) == 1) {
+                pushWork(launch, i);
+                num_ready++;
+            }
+        }
+        if (wake) {
+            wakeWorkers(num_ready);
+        }
+        dropRef(launch);
+        return num_ready;
+    }
+    // 发出 min(任务数, 线程数) 个令牌，每个令牌持有一个引用
+    int num_tokens = std::min(num_total_tasks, this->thread_num);
+    launch->refs.fetch_add(num_tokens);
+    for (int i = 0; i < num_tokens; i++) {
+        pushWork(launch, -1);
+    }
+    if (wake) {
+        wakeWorkers(num_tokens);
+    }
+    return num_tokens;
+}
+
+void TaskSystemParallelThreadPoolSleeping::finishLaunch(Launch* launch) {
+    TaskTrace::instant(TaskTrace::LAUNCH_COMPLETE, launch->id, launch->num_total_tasks);
+    // 置 done 之后不会再有新的后继和 continuation 追加进来，下面可以不加锁地遍历
+    {
+        std::lock_guard<std::mutex> lock(launch->lock);
+        launch->done.store(true);
+    }
+    for (int i = 0; i < (int)launch->arena_users.size(); i++) {
+        if (launch->arena_users[i]) {
+            releaseArena(i);
+        }
+    }
+    SuccessorBlock* block = &launch->successors;
+    for (int i = 0; i < launch->num_successors; i++) {
+        if (i > 0 && i % SuccessorBlock::CAPACITY == 0) {
+            block = block->next;
+        }
+        Launch* successor = block->launches[i % SuccessorBlock::CAPACITY];
+        if (successor->pending_deps.fetch_sub(1) == 1) {
+            readyLaunch(successor, true);
+        }
+    }
+    // continuation 在完成最后一个任务的线程上执行，执行期间不持有任何锁，
+    // 这样 continuation 里可以继续提交新的启动
+    for (const std::function<void()>& continuation : launch->continuations) {
+        continuation();
+    }
+    dropRef(launch);
+    // continuation 执行完之后才算完成，保证 sync() 返回时所有 continuation 都已返回
+    if (this->unfinished_launches.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(this->sync_lock);
+        this->sync_cv.notify_all();
+    }
+}
+
+void TaskSystemParallelThreadPoolSleeping::dropRef(Launch* launch) {
+    if (launch->refs.fetch_sub(1) != 1) {
+        return;
+    }
+    // 最后一个引用：压入 retired 栈，由提交线程回收
+    Launch* head = this->retired.load();
+    do {
+        launch->next_retired = head;
+    } while (!this->retired.compare_exchange_weak(head, launch));
+}
 
-    //
-    // TODO: CS149 students will implement this method in Part B.
-    //
+void TaskSystemParallelThreadPoolSleeping::run(IRunnable* runnable, int num_total_tasks) {
+    // 只等待本次启动完成，而不是 sync() 等待所有启动，多个线程同时调用 run() 时互不拖累
+    std::vector<TaskID> no_deps;
+    TaskID id = runAsyncWithDeps(runnable, num_total_tasks, no_deps);
+    std::mutex done_lock;
+    std::condition_variable done_cv;
+    bool done = false;
+    then(id, [&]() {
+        std::lock_guard<std::mutex> lock(done_lock);
+        done = true;
+        done_cv.notify_all();
+    });
+    std::unique_lock<std::mutex> lock(done_lock);
+    done_cv.wait(lock, [&] { return done; });
+}
 
+TaskSystemParallelThreadPoolSleeping::Launch* TaskSystemParallelThreadPoolSleeping::newLaunch(IRunnable* runnable, int num_total_tasks) {
+    reclaimRetired();
+    Launch* launch;
+    if (!this->free_launches.empty()) {
+        launch = this->free_launches.back();
+        this->free_launches.pop_back();
+    } else {
+        launch = new Launch();
+    }
+    launch->runnable = runnable;
+    launch->num_total_tasks = num_total_tasks;
+    launch->next_task = 0;
+    launch->finished_tasks = 0;
+    // 提交守卫，submitLaunch() 登记完所有依赖后释放
+    launch->pending_deps = 1;
+    // 完成处理持有的引用
+    launch->refs = 1;
+    launch->done = false;
+    launch->successors.next = nullptr;
+    launch->successors_tail = &launch->successors;
+    launch->num_successors = 0;
+    // 任务数组只增不减，最小 64 项，稳态下不需要重新分配
+    if (launch->task_capacity < num_total_tasks) {
+        delete[] launch->task_finished;
+        delete[] launch->task_pending;
+        launch->task_capacity = std::max(num_total_tasks, 64);
+        launch->task_finished = new std::atomic<bool>[launch->task_capacity];
+        launch->task_pending = new std::atomic<int>[launch->task_capacity];
+    }
     for (int i = 0; i < num_total_tasks; i++) {
-        runnable->runTask(i, num_total_tasks);
+        launch->task_finished[i].store(false, std::memory_order_relaxed);
+    }
+    launch->task_level = false;
+    launch->has_task_successors = false;
+    launch->is_event = false;
+    launch->signaled = false;
+    launch->arena_users.assign(this->thread_num, 0);
+    launch->dep_mark = 0;
+    launch->implied_mark = 0;
+    return launch;
+}
+
+void TaskSystemParallelThreadPoolSleeping::reclaimRetired() {
+    // 一次取走整个栈，不存在 ABA 问题
+    Launch* launch = this->retired.exchange(nullptr);
+    while (launch) {
+        Launch* next = launch->next_retired;
+        // 溢出块归还到池中，vector 成员只清空不释放，保留容量供下次复用
+        SuccessorBlock* block = launch->successors.next;
+        while (block) {
+            SuccessorBlock* next_block = block->next;
+            this->free_blocks.push_back(block);
+            block = next_block;
+        }
+        launch->continuations.clear();
+        launch->pred_ids.clear();
+        if (launch->has_task_successors) {
+            for (int i = 0; i < launch->num_total_tasks; i++) {
+                launch->task_successors[i].clear();
+            }
+        }
+        this->free_launches.push_back(launch);
+        launch = next;
+    }
+}
+
+TaskSystemParallelThreadPoolSleeping::Launch* TaskSystemParallelThreadPoolSleeping::findLaunch(TaskID id) {
+    if (id < 0 || id >= this->next_task_id) {
+        return nullptr;
+    }
+    size_t mask = this->launch_table.size() - 1;
+    // 线性探测，遇到空槽位说明 id 不在表中
+    for (size_t i = id & mask; this->launch_table[i].launch; i = (i + 1) & mask) {
+        const LaunchSlot& slot = this->launch_table[i];
+        if (slot.id == id) {
+            // 记录可能已完成，或已被回收给另一个 TaskID
+            Launch* launch = slot.launch;
+            return launch->id == id && !launch->done.load() ? launch : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+void TaskSystemParallelThreadPoolSleeping::insertLaunch(Launch* launch) {
+    // 已用槽位 (含失效的槽位) 超过一半时重建表，只保留未完成的启动
+    if ((this->launch_table_used + 1) * 2 > this->launch_table.size()) {
+        size_t live = 0;
+        for (const LaunchSlot& slot : this->launch_table) {
+            if (slot.launch && slot.launch->id == slot.id && !slot.launch->done.load()) {
+                live++;
+            }
+        }
+        // 重建后未完成的启动最多占四分之一，表的大小只取决于同时未完成的启动数；
+        // 大小不变时重建到备用表中，不分配内存
+        size_t size = this->launch_table.size();
+        while ((live + 1) * 4 > size) {
+            size *= 2;
+        }
+        this->launch_table_spare.assign(size, LaunchSlot());
+        size_t mask = size - 1;
+        for (const LaunchSlot& slot : this->launch_table) {
+            if (slot.launch && slot.launch->id == slot.id && !slot.launch->done.load()) {
+                size_t i = slot.id & mask;
+                while (this->launch_table_spare[i].launch) {
+                    i = (i + 1) & mask;
+                }
+                this->launch_table_spare[i] = slot;
+            }
+        }
+        this->launch_table.swap(this->launch_table_spare);
+        this->launch_table_used = live;
+    }
+    size_t mask = this->launch_table.size() - 1;
+    size_t i = launch->id & mask;
+    while (true) {
+        LaunchSlot& slot = this->launch_table[i];
+        if (slot.launch == nullptr) {
+            this->launch_table_used++;
+            break;
+        }
+        // 失效的槽位 (启动已完成或记录已被复用) 可以直接覆盖，探测链不会因此断开
+        if (slot.launch->id != slot.id || slot.launch->done.load()) {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    this->launch_table[i].id = launch->id;
+    this->launch_table[i].launch = launch;
+}
+
+bool TaskSystemParallelThreadPoolSleeping::addSuccessor(Launch* launch, Launch* successor) {
+    std::lock_guard<std::mutex> lock(launch->lock);
+    if (launch->done.load()) {
+        return false;
+    }
+    int slot = launch->num_successors % SuccessorBlock::CAPACITY;
+    if (launch->num_successors > 0 && slot == 0) {
+        SuccessorBlock* block;
+        if (!this->free_blocks.empty()) {
+            block = this->free_blocks.back();
+            this->free_blocks.pop_back();
+        } else {
+            block = new SuccessorBlock();
+        }
+        block->next = nullptr;
+        launch->successors_tail->next = block;
+        launch->successors_tail = block;
+    }
+    launch->successors_tail->launches[slot] = successor;
+    launch->num_successors++;
+    // 在 launch 的锁内增加计数，保证 launch 完成时一定能看到这个依赖
+    successor->pending_deps.fetch_add(1);
+    return true;
+}
+
+void TaskSystemParallelThreadPoolSleeping::beginDeps() {
+    this->dep_scratch.clear();
+    this->dep_stamp++;
+}
+
+void TaskSystemParallelThreadPoolSleeping::collectDep(TaskID dep) {
+    // 已完成的依赖直接剪除
+    Launch* pred = findLaunch(dep);
+    if (pred == nullptr) {
+        this->pruning_stats.completed++;
+        return;
+    }
+    if (pred->dep_mark == this->dep_stamp) {
+        this->pruning_stats.duplicate++;
+        return;
+    }
+    pred->dep_mark = this->dep_stamp;
+    this->dep_scratch.push_back(pred);
+}
+
+void TaskSystemParallelThreadPoolSleeping::commitDeps(Launch* launch) {
+    int window = this->dep_pruning_window;
+    if (window > 0) {
+        // 依赖 B 自己直接依赖 A (且 A、B 都未完成) 时，对 A 的依赖可由 B 传递得到
+        int num_deps = std::min((int)this->dep_scratch.size(), window);
+        for (int i = 0; i < num_deps; i++) {
+            const std::vector<TaskID>& pred_ids = this->dep_scratch[i]->pred_ids;
+            int num_preds = std::min((int)pred_ids.size(), window);
+            for (int j = 0; j < num_preds; j++) {
+                Launch* implied = findLaunch(pred_ids[j]);
+                if (implied && implied->dep_mark == this->dep_stamp) {
+                    implied->implied_mark = this->dep_stamp;
+                }
+            }
+        }
+    }
+    for (Launch* pred : this->dep_scratch) {
+        if (pred->implied_mark == this->dep_stamp) {
+            this->pruning_stats.transitive++;
+            continue;
+        }
+        // 收集之后才完成的依赖同样算作已完成
+        if (!addSuccessor(pred, launch)) {
+            this->pruning_stats.completed++;
+            continue;
+        }
+        if (window > 0) {
+            launch->pred_ids.push_back(pred->id);
+        }
+        this->pruning_stats.kept++;
+    }
+}
+
+void TaskSystemParallelThreadPoolSleeping::addTaskDep(Launch* launch, const TaskDep& dep) {
+    // trace 只能表示窗口映射，CUSTOM 映射记为依赖全部任务
+    int radius = dep.mapping == TaskDep::IDENTITY ? 0 : dep.mapping == TaskDep::WINDOW ? dep.radius : -1;
+    TaskTrace::dep(launch->id, dep.launch, radius);
+    Launch* pred = findLaunch(dep.launch);
+    // 没有任务的前驱 (例如用户事件) 无法按任务映射，退化为启动级依赖
+    if (dep.mapping == TaskDep::ALL || pred == nullptr || pred->num_total_tasks <= 0) {
+        collectDep(dep.launch);
+        return;
+    }
+    if (!launch->task_level) {
+        launch->task_level = true;
+        for (int i = 0; i < launch->num_total_tasks; i++) {
+            launch->task_pending[i] = 1;
+        }
+    }
+    std::lock_guard<std::mutex> lock(pred->lock);
+    if (pred->done.load()) {
+        return;
     }
+    // 先置 has_task_successors 再检查 task_finished，与 runTask() 中的顺序相反
+    pred->has_task_successors.store(true);
+    if ((int)pred->task_successors.size() < pred->num_total_tasks) {
+        pred->task_successors.resize(pred->num_total_tasks);
+    }
+    // 对每个任务 i 枚举它依赖的前驱任务，未完成的前驱任务登记 i 为后继
+    std::vector<int> dep_task_ids;
+    for (int i = 0; i < launch->num_total_tasks; i++) {
+        dep_task_ids.clear();
+        if (dep.mapping == TaskDep::IDENTITY) {
+            dep_task_ids.push_back(i);
+        } else if (dep.mapping == TaskDep::WINDOW) {
+            for (int j = i - dep.radius; j <= i + dep.radius; j++) {
+                dep_task_ids.push_back(j);
+            }
+        } else {
+            dep.custom(i, dep_task_ids);
+        }
+        for (int j : dep_task_ids) {
+            if (j < 0 || j >= pred->num_total_tasks || pred->task_finished[j].load()) {
+                continue;
+            }
+            TaskRef ref = { launch, i };
+            pred->task_successors[j].push_back(ref);
+            launch->task_pending[i]++;
+        }
+    }
+}
 
+int TaskSystemParallelThreadPoolSleeping::submitLaunch(Launch* launch, bool wake) {
+    insertLaunch(launch);
+    TaskTrace::instant(TaskTrace::LAUNCH_SUBMIT, launch->id, launch->num_total_tasks);
+    this->unfinished_launches++;
+    // 释放提交守卫；依赖都已满足 (或都已在登记期间完成) 时立即就绪
+    if (launch->pending_deps.fetch_sub(1) == 1) {
+        return readyLaunch(launch, wake);
+    }
     return 0;
 }
 
+TaskID TaskSystemParallelThreadPoolSleeping::runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
+                                                    const std::vector<TaskID>& deps) {
+    std::lock_guard<std::mutex> lock(this->submit_lock);
+    Launch* launch = newLaunch(runnable, num_total_tasks);
+    TaskID id = launch->id = this->next_task_id++;
+    beginDeps();
+    for (TaskID dep : deps) {
+        TaskTrace::dep(id, dep, -1);
+        collectDep(dep);
+    }
+    commitDeps(launch);
+    submitLaunch(launch, true);
+    return id;
+}
+
+TaskID TaskSystemParallelThreadPoolSleeping::runAsyncWithTaskDeps(IRunnable* runnable, int num_total_tasks,
+                                                        const std::vector<TaskDep>& deps) {
+    std::lock_guard<std::mutex> lock(this->submit_lock);
+    Launch* launch = newLaunch(runnable, num_total_tasks);
+    TaskID id = launch->id = this->next_task_id++;
+    beginDeps();
+    for (const TaskDep& dep : deps) {
+        addTaskDep(launch, dep);
+    }
+    commitDeps(launch);
+    submitLaunch(launch, true);
+    return id;
+}
+
+void TaskSystemParallelThreadPoolSleeping::submitBatch(const LaunchDesc* descs, int count,
+                                                       TaskID* out_ids) {
+    // 整个批次只加一次锁；批次内的就绪启动先入队，结束时统一唤醒 workers
+    std::lock_guard<std::mutex> lock(this->submit_lock);
+    int num_queued = 0;
+    for (int i = 0; i < count; i++) {
+        Launch* launch = newLaunch(descs[i].runnable, descs[i].num_total_tasks);
+        out_ids[i] = launch->id = this->next_task_id++;
+        beginDeps();
+        for (TaskID dep : descs[i].deps) {
+            TaskTrace::dep(out_ids[i], dep, -1);
+            collectDep(dep);
+        }
+        // 批次内的依赖按下标引用前面的条目，已完成的条目不会被找到
+        for (int idx : descs[i].batch_deps) {
+            TaskTrace::dep(out_ids[i], out_ids[idx], -1);
+            collectDep(out_ids[idx]);
+        }
+        commitDeps(launch);
+        num_queued += submitLaunch(launch, false);
+    }
+    wakeWorkers(num_queued);
+}
+
 void TaskSystemParallelThreadPoolSleeping::sync() {
+    std::unique_lock<std::mutex> lock(this->sync_lock);
+    this->sync_cv.wait(lock, [this] { return this->unfinished_launches.load() == 0; });
+}
+
+void TaskSystemParallelThreadPoolSleeping::then(TaskID task_id, const std::function<void()>& continuation) {
+    {
+        std::lock_guard<std::mutex> lock(this->submit_lock);
+        Launch* launch = findLaunch(task_id);
+        if (launch) {
+            std::lock_guard<std::mutex> launch_lock(launch->lock);
+            if (!launch->done.load()) {
+                launch->continuations.push_back(continuation);
+                return;
+            }
+        }
+    }
+    // 启动已经完成，直接在调用线程执行
+    continuation();
+}
+
+TaskID TaskSystemParallelThreadPoolSleeping::createEvent() {
+    // 事件是一个没有任务的启动，除提交守卫外还带一个只有 signal() 才会释放的依赖
+    std::lock_guard<std::mutex> lock(this->submit_lock);
+    Launch* launch = newLaunch(nullptr, 0);
+    launch->is_event = true;
+    launch->pending_deps = 2;
+    TaskID id = launch->id = this->next_task_id++;
+    submitLaunch(launch, true);
+    return id;
+}
+
+void TaskSystemParallelThreadPoolSleeping::signal(TaskID event) {
+    Launch* launch;
+    {
+        std::lock_guard<std::mutex> lock(this->submit_lock);
+        launch = findLaunch(event);
+        // 已经 signal 过的事件不受影响；不是事件的 TaskID 不受影响
+        if (launch == nullptr || !launch->is_event || launch->signaled) {
+            return;
+        }
+        launch->signaled = true;
+    }
+    // 在锁外释放依赖：完成事件会连带执行后继的 continuation，其中可能提交新的启动。
+    // 在此之前事件不会完成，launch 仍然有效
+    if (launch->pending_deps.fetch_sub(1) == 1) {
+        readyLaunch(launch, true);
+    }
+}
+
+void TaskSystemParallelThreadPoolSleeping::setDepPruningWindow(int window) {
+    std::lock_guard<std::mutex> lock(this->submit_lock);
+    this->dep_pruning_window = window;
+}
+
+DepPruningStats TaskSystemParallelThreadPoolSleeping::depPruningStats() {
+    std::lock_guard<std::mutex> lock(this->submit_lock);
+    return this->pruning_stats;
+}
+
+WakeupStats TaskSystemParallelThreadPoolSleeping::wakeupStats() {
+    WakeupStats stats;
+    stats.launches = this->num_ready_launches.load();
+    stats.wakeups = this->num_wakeups.load();
+    stats.spurious_wakeups = this->num_spurious_wakeups.load();
+    return stats;
+}
+
+// 启动记录、后继块和任务数组都由池复用，预热之后提交和执行启动都不分配堆内存
+bool TaskSystemParallelThreadPoolSleeping::allocationFreeLaunches() {
+    return true;
+}
 
-    //
-    // TODO: CS149 students will modify the implementation of this method in Part B.
-    //
+TaskSystemStats TaskSystemParallelThreadPoolSleeping::stats() {
+    TaskSystemStats stats = ITaskSystem::stats();
+    for (int i = 0; i < this->thread_num; i++) {
+        stats.workers.push_back(this->counters[i].snapshot());
+    }
+    return stats;
+}
 
-    return;
+TaskArenaStats TaskSystemParallelThreadPoolSleeping::arenaStats() {
+    TaskArenaStats stats;
+    std::lock_guard<std::mutex> lock(this->submit_lock);
+    for (TaskArena* arena : this->arenas) {
+        if (arena) stats.add(arena->stats());
+    }
+    return stats;
 }
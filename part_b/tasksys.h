@@ -2,6 +2,51 @@
 #define _TASKSYS_H
 
 #include "itasksys.h"
+#include "tasktrace.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <stdint.h>
+#include <set>
+#include <algorithm>
+
+/*
+ * DeferredLaunches: dependency bookkeeping for the task systems below
+ * that execute bulk task launches synchronously inside
+ * runAsyncWithDeps().  A launch runs on the calling thread immediately,
+ * unless it depends on a user event that has not been signaled yet
+ * (directly or through another deferred launch).  Deferred launches run
+ * on the thread that signals the event they were waiting for.
+ */
+class DeferredLaunches {
+    public:
+        DeferredLaunches();
+        TaskID launch(ITaskSystem* system, IRunnable* runnable, int num_total_tasks,
+                      const std::vector<TaskID>& deps);
+        TaskID createEvent();
+        void signal(ITaskSystem* system, TaskID event);
+        void sync();
+    private:
+        struct Deferred {
+            TaskID id;
+            IRunnable* runnable;
+            int num_total_tasks;
+            std::vector<TaskID> deps;
+        };
+        // deps 中是否有未完成的事件或被推迟的启动 (需持有 lock)
+        bool blocked(const std::vector<TaskID>& deps);
+
+        TaskID next_task_id;
+        // 未 signal 的事件，以及被推迟、尚未执行完的启动
+        std::set<TaskID> incomplete;
+        // 未 signal 的事件
+        std::set<TaskID> events;
+        std::vector<Deferred> deferred;
+        std::mutex lock;
+        std::condition_variable sync_cv;
+};
 
 /*
  * TaskSystemSerial: This class is the student's implementation of a
@@ -17,6 +62,10 @@ class TaskSystemSerial: public ITaskSystem {
         TaskID runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
                                 const std::vector<TaskID>& deps);
         void sync();
+        TaskID createEvent();
+        void signal(TaskID event);
+    private:
+        DeferredLaunches deferred;
 };
 
 /*
@@ -34,6 +83,10 @@ class TaskSystemParallelSpawn: public ITaskSystem {
         TaskID runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
                                 const std::vector<TaskID>& deps);
         void sync();
+        TaskID createEvent();
+        void signal(TaskID event);
+    private:
+        DeferredLaunches deferred;
 };
 
 /*
@@ -51,6 +104,88 @@ class TaskSystemParallelThreadPoolSpinning: public ITaskSystem {
         TaskID runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
                                 const std::vector<TaskID>& deps);
         void sync();
+        TaskID createEvent();
+        void signal(TaskID event);
+    private:
+        DeferredLaunches deferred;
+};
+
+/*
+ * WorkQueue: a bounded lock-free multi-producer multi-consumer queue
+ * (Vyukov's array-based design).  Every cell carries a sequence number
+ * that tells producers and consumers whether it is free or full for the
+ * lap they are on, so push() and pop() each take a single CAS on the
+ * shared position in the common case and never block.  push() returns
+ * false when the queue is full.
+ */
+template <typename T>
+class WorkQueue {
+    public:
+        WorkQueue(size_t capacity): mask_(capacity - 1), enqueue_pos_(0), dequeue_pos_(0) {
+            // capacity 必须是 2 的幂
+            cells_ = new Cell[capacity];
+            for (size_t i = 0; i < capacity; i++) {
+                cells_[i].seq.store(i, std::memory_order_relaxed);
+            }
+        }
+        ~WorkQueue() {
+            delete[] cells_;
+        }
+
+        bool push(const T& value) {
+            size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+            while (true) {
+                Cell* cell = &cells_[pos & mask_];
+                size_t seq = cell->seq.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+                if (diff == 0) {
+                    if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        cell->value = value;
+                        cell->seq.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    // 队列已满
+                    return false;
+                } else {
+                    pos = enqueue_pos_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        bool pop(T& value) {
+            size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+            while (true) {
+                Cell* cell = &cells_[pos & mask_];
+                size_t seq = cell->seq.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+                if (diff == 0) {
+                    if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        value = cell->value;
+                        cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    // 队列为空
+                    return false;
+                } else {
+                    pos = dequeue_pos_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+    private:
+        struct Cell {
+            std::atomic<size_t> seq;
+            T value;
+        };
+        Cell* cells_;
+        size_t mask_;
+        // 生产者和消费者的位置之间隔开一个缓存行，避免伪共享
+        // (C++11 的 new 不保证 alignas(64) 的对齐，所以用填充)
+        std::atomic<size_t> enqueue_pos_;
+        char pad_[64];
+        std::atomic<size_t> dequeue_pos_;
 };
 
 /*
@@ -67,7 +202,210 @@ class TaskSystemParallelThreadPoolSleeping: public ITaskSystem {
         void run(IRunnable* runnable, int num_total_tasks);
         TaskID runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
                                 const std::vector<TaskID>& deps);
+        TaskID runAsyncWithTaskDeps(IRunnable* runnable, int num_total_tasks,
+                                    const std::vector<TaskDep>& deps);
+        void submitBatch(const LaunchDesc* descs, int count, TaskID* out_ids);
         void sync();
+        void then(TaskID task_id, const std::function<void()>& continuation);
+        TaskID createEvent();
+        void signal(TaskID event);
+        TaskArenaStats arenaStats();
+        void setDepPruningWindow(int window);
+        DepPruningStats depPruningStats();
+        WakeupStats wakeupStats();
+        bool allocationFreeLaunches();
+        TaskSystemStats stats();
+        void worker(int thread_id);
+    private:
+        struct Launch;
+        // 任务级后继：某个启动中的某个任务
+        struct TaskRef {
+            Launch* launch;
+            int task_id;
+        };
+        // worker 的停车位：signaled 由 lock 保护，填充到缓存行大小，避免相邻 worker 的停车位伪共享
+        struct ParkingSlot {
+            std::mutex lock;
+            std::condition_variable cv;
+            bool signaled;
+            char pad[64];
+        };
+        // launch_table 的一个槽位：launch 为空表示空槽位；
+        // launch 已完成或已被复用为其他 TaskID (launch->id != id) 时为失效的槽位
+        struct LaunchSlot {
+            TaskID id;
+            Launch* launch;
+
+            LaunchSlot(): id(-1), launch(nullptr) {}
+        };
+        // 工作队列中的一项：task_id >= 0 表示 task_level 启动中已就绪的单个任务，
+        // task_id < 0 表示普通启动的一个令牌，持有令牌的 worker 不断领取该启动的任务直到领完
+        struct WorkItem {
+            Launch* launch;
+            int task_id;
+        };
+        // 启动级后继的存储块：第一个块内嵌在 Launch 中，后继较多时从 free_blocks 池中取溢出块串成链表
+        struct SuccessorBlock {
+            static const int CAPACITY = 6;
+            Launch* launches[CAPACITY];
+            SuccessorBlock* next;
+        };
+        // 一次批量任务启动 (bulk task launch) 的记录。
+        // 提交时的字段由 submit_lock 保护；执行期间的计数都是原子变量，
+        // 完成路径不需要任何全局锁。记录完成后回收到 free_launches 池中复用
+        struct Launch {
+            TaskID id;
+            IRunnable* runnable;
+            int num_total_tasks;
+            // 普通启动下一个待领取的任务编号
+            std::atomic<int> next_task;
+            // 已完成的任务数，完成最后一个任务的线程负责完成整个启动
+            std::atomic<int> finished_tasks;
+            // 尚未满足的启动级依赖数，另加一个提交守卫 (事件还要再加一个 signal 守卫)；
+            // 把它减到 0 的线程负责让启动就绪
+            std::atomic<int> pending_deps;
+            // 引用计数：完成处理占一个，每个发出的令牌占一个；减到 0 的线程把记录放入 retired
+            std::atomic<int> refs;
+            // 启动已完成，不再接受新的后继和 continuation
+            std::atomic<bool> done;
+            // 保护 successors 的追加、continuations 和 task_successors (每个启动一把锁)
+            std::mutex lock;
+            // 依赖本次启动的后继启动：num_successors 个，依次存放在 successors 及其后的溢出块中
+            SuccessorBlock successors;
+            SuccessorBlock* successors_tail;
+            int num_successors;
+            // 本次启动完成后要执行的 continuation
+            std::vector<std::function<void()>> continuations;
+            // 每个任务是否已完成，用于登记任务级依赖时跳过已完成的前驱任务
+            std::atomic<bool>* task_finished;
+            // 是否有任务级依赖
+            bool task_level;
+            // 每个任务尚未完成的前驱任务数，另加一个在启动级依赖满足时释放的守卫 (仅 task_level)
+            std::atomic<int>* task_pending;
+            // task_finished / task_pending 数组的容量
+            int task_capacity;
+            // 每个任务完成后要通知的任务级后继，has_task_successors 为 true 时前 num_total_tasks 项有效
+            std::vector<std::vector<TaskRef>> task_successors;
+            std::atomic<bool> has_task_successors;
+            // 用户事件：没有任务，由 signal() 释放一个人为的启动级依赖
+            bool is_event;
+            bool signaled;
+            // 哪些 worker 执行过本次启动的任务 (即可能在其 arena 上分配过内存)，每个 worker 只写自己的一项
+            std::vector<char> arena_users;
+            // 登记的启动级依赖的 TaskID (仅在开启传递规约时记录)，用于判断后来的启动的依赖是否可由本启动传递得到
+            std::vector<TaskID> pred_ids;
+            // 提交某个启动时的标记：是否已在其依赖列表中 / 是否被其他依赖传递蕴含
+            unsigned long long dep_mark;
+            unsigned long long implied_mark;
+            // retired 链表中的下一个记录
+            Launch* next_retired;
+
+            Launch(): task_finished(nullptr), task_pending(nullptr), task_capacity(0) {}
+            ~Launch() {
+                delete[] task_finished;
+                delete[] task_pending;
+            }
+        };
+        // 从池中取出并初始化一个启动记录 / 回收 retired 中的记录 (需持有 submit_lock)
+        Launch* newLaunch(IRunnable* runnable, int num_total_tasks);
+        void reclaimRetired();
+        // 在 launch_table 中查找未完成的启动，已完成则返回 nullptr (需持有 submit_lock)
+        Launch* findLaunch(TaskID id);
+        void insertLaunch(Launch* launch);
+        // 把 successor 记为 launch 的启动级后继；launch 已完成时返回 false (需持有 submit_lock)
+        bool addSuccessor(Launch* launch, Launch* successor);
+        // 登记启动级依赖：beginDeps() 之后用 collectDep() 收集依赖，剪除已完成和重复的依赖，
+        // 再由 commitDeps() 做有界的传递规约并登记剩下的依赖 (需持有 submit_lock)
+        void beginDeps();
+        void collectDep(TaskID dep);
+        void commitDeps(Launch* launch);
+        // 登记任务级依赖，ALL 和没有任务的前驱交给 collectDep() (需持有 submit_lock)
+        void addTaskDep(Launch* launch, const TaskDep& dep);
+        // 登记到 launch_table 并释放提交守卫；wake 为 false 时不唤醒 workers，
+        // 返回入队的工作项数 (需持有 submit_lock)
+        int submitLaunch(Launch* launch, bool wake);
+        // 依赖全部满足：普通启动发出令牌，task_level 启动释放每个任务的守卫，没有任务则直接完成。
+        // 返回入队的工作项数
+        int readyLaunch(Launch* launch, bool wake);
+        // 执行一个任务并处理它的完成
+        void runTask(Launch* launch, int task_id, int thread_id);
+        // 最后一个任务完成后调用：释放后继、执行 continuation
+        void finishLaunch(Launch* launch);
+        void dropRef(Launch* launch);
+        // 工作队列的入队 / 出队，队列满时溢出到 overflow
+        void pushWork(Launch* launch, int task_id);
+        bool popWork(WorkItem& item);
+        // 唤醒至多 count 个睡眠的 workers
+        void wakeWorkers(int count);
+        // 没有工作时在自己的停车位上睡眠，返回 false 表示要退出
+        bool park(int thread_id);
+        // worker 第一次执行某个启动的任务前 / 启动完成后调整该 worker 的 arena 引用计数，
+        // 计数归零时 reset 该 arena
+        void acquireArena(int thread_id);
+        void releaseArena(int thread_id);
+
+        // 总线程数 (构造函数设置好，无需锁)
+        int thread_num;
+        // 线程池指针 (构造函数设置好，无需锁)
+        std::thread *thread_pool;
+
+        // ---- 提交状态，由 submit_lock 保护 ----
+        std::mutex submit_lock;
+        // 下一个分配的 TaskID，TaskID 单调递增
+        TaskID next_task_id;
+        // 提交过的启动，以 TaskID & (size - 1) 为起点线性探测的开放寻址表，大小为 2 的幂。
+        // 找不到或槽位已失效说明要找的启动已完成。失效的槽位只在重建时清除，
+        // 重建时按未完成的启动数确定大小，所以表的大小与已发出的 TaskID 数无关；
+        // launch_table_used 为非空槽位数，launch_table_spare 是重建用的备用表
+        std::vector<LaunchSlot> launch_table;
+        std::vector<LaunchSlot> launch_table_spare;
+        size_t launch_table_used;
+        // 已回收、可复用的启动记录和后继溢出块
+        std::vector<Launch*> free_launches;
+        std::vector<SuccessorBlock*> free_blocks;
+        // 正在收集的启动级依赖及本次收集的标记值
+        std::vector<Launch*> dep_scratch;
+        unsigned long long dep_stamp;
+        // 传递规约的窗口大小 (0 表示关闭) 和剪枝计数
+        int dep_pruning_window;
+        DepPruningStats pruning_stats;
+        // 每个 worker 的 TaskArena
+        std::vector<TaskArena*> arenas;
+
+        // ---- 执行状态，均为无锁结构 ----
+        // 已就绪的工作；队列满时溢出到 overflow (由 overflow_lock 保护，很少用到)
+        WorkQueue<WorkItem> work_queue;
+        std::mutex overflow_lock;
+        std::vector<WorkItem> overflow;
+        std::atomic<int> overflow_size;
+        // 已入队、尚未被取走的工作数 (可能短暂为负)，workers 据此决定是否睡眠
+        std::atomic<int> queued_items;
+        // 引用计数归零、等待提交线程回收的启动记录 (无锁栈，提交线程一次取走全部)
+        std::atomic<Launch*> retired;
+        // 已提交但未完成的启动数，为 0 时 sync() 返回
+        std::atomic<int> unfinished_launches;
+        // 每个 worker 的 arena 引用计数：执行过任务、尚未完成的启动数；-1 表示正在 reset
+        std::atomic<int>* arena_refs;
+
+        // ---- 睡眠与唤醒 ----
+        // 每个 worker 有自己的停车位，只有被选中唤醒的 worker 才会醒来
+        ParkingSlot* slots;
+        // 正在睡眠 (或准备睡眠) 的 workers，后进先出，优先唤醒刚睡下、缓存还热的 worker (由 idle_lock 保护)
+        std::mutex idle_lock;
+        std::vector<int> idle_workers;
+        // idle_workers 的大小，入队方据此无锁地判断是否需要唤醒
+        std::atomic<int> idle_count;
+        // 表示是否要销毁线程，用于通知 worker 退出 (由 idle_lock 保护)
+        bool stop;
+        // 唤醒计数
+        std::atomic<long long> num_ready_launches;
+        std::atomic<long long> num_wakeups;
+        std::atomic<long long> num_spurious_wakeups;
+        // 每个 worker 自己的计数器，只有该 worker 写入
+        WorkerCounters* counters;
+        // sync() 在此等待所有启动完成
+        std::mutex sync_lock;
+        std::condition_variable sync_cv;
 };
 
 #endif
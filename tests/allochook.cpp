@@ -0,0 +1,24 @@
+#include <stdlib.h>
+#include <new>
+
+#include "allochook.h"
+
+std::atomic<bool> g_count_allocations(false);
+std::atomic<long long> g_num_allocations(0);
+
+// noinline keeps GCC from pairing the inlined malloc() and free() calls
+// with new-expressions and delete-expressions (-Wmismatched-new-delete).
+__attribute__((noinline)) void* operator new(size_t size) {
+    if (g_count_allocations.load(std::memory_order_relaxed)) {
+        g_num_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
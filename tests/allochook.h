@@ -0,0 +1,19 @@
+#ifndef _ALLOCHOOK_H
+#define _ALLOCHOOK_H
+
+#include <atomic>
+
+/*
+ * Allocation counting hook: while g_count_allocations is set, every call
+ * to the global operator new (from any thread) increments
+ * g_num_allocations.  Used to check that a task system does not touch
+ * the heap on its steady-state launch path.
+ *
+ * The replacement operator new and operator delete are defined once, in
+ * allochook.cpp, which must be linked into every program that includes
+ * tests.h.
+ */
+extern std::atomic<bool> g_count_allocations;
+extern std::atomic<long long> g_num_allocations;
+
+#endif
@@ -0,0 +1,286 @@
+import argparse
+import json
+import sys
+
+# 读取 runtasks --trace 导出的 Chrome trace (见 common/tasktrace.h)，重建任务图，
+# 报告实际的关键路径、随时间变化的并行度、每个启动的 slack，以及 work/span 给出的加速比上界，
+# 用来判断一次运行受限于任务图本身还是受限于调度器
+
+
+class Launch:
+    def __init__(self, launch_id):
+        self.id = launch_id
+        self.num_tasks = 0
+        self.submit = None
+        self.ready = None
+        self.complete = None
+        # task_id -> 运行时长 (us)
+        self.task_durations = {}
+        # (dep launch id, radius)，radius < 0 表示依赖全部任务
+        self.deps = []
+        self.first_start = None
+        self.last_end = None
+
+    def execution(self):
+        # 从第一个任务开始到启动完成的时间
+        if self.first_start is None:
+            return 0.0
+        end = self.complete if self.complete is not None else self.last_end
+        return max(0.0, end - self.first_start)
+
+
+def load_trace(path):
+    with open(path) as f:
+        trace = json.load(f)
+    launches = {}
+    spans = []
+    label = "trace"
+
+    def launch(launch_id):
+        if launch_id not in launches:
+            launches[launch_id] = Launch(launch_id)
+        return launches[launch_id]
+
+    for e in trace["traceEvents"]:
+        name = e.get("name")
+        args = e.get("args", {})
+        if name == "process_name":
+            label = args.get("name", label)
+        elif name == "task":
+            start, dur = e["ts"], e["dur"]
+            spans.append((start, start + dur, e["tid"]))
+            if args["launch"] < 0:
+                continue
+            l = launch(args["launch"])
+            count = max(1, args["count"])
+            # 一个 chunk 内的任务平分 chunk 的时长
+            for i in range(args["task"], args["task"] + count):
+                l.task_durations[i] = l.task_durations.get(i, 0.0) + dur / count
+            l.first_start = start if l.first_start is None else min(l.first_start, start)
+            l.last_end = start + dur if l.last_end is None else max(l.last_end, start + dur)
+        elif name == "launch submit":
+            l = launch(args["launch"])
+            l.submit = e["ts"]
+            l.num_tasks = args["tasks"]
+        elif name == "launch ready":
+            launch(args["launch"]).ready = e["ts"]
+        elif name == "launch complete":
+            l = launch(args["launch"])
+            l.complete = e["ts"]
+            l.num_tasks = max(l.num_tasks, args["tasks"])
+        elif name == "launch dep":
+            launch(args["launch"]).deps.append((args["dep"], args["radius"]))
+    return label, launches, spans
+
+
+def add_serial_deps(launches):
+    # 同步 run() 的调用者按顺序提交启动，每个启动隐式依赖上一个
+    ids = sorted(launches)
+    for prev, cur in zip(ids, ids[1:]):
+        launches[cur].deps.append((prev, -1))
+
+
+def span_of_graph(launches):
+    # 无限多 worker、零调度开销时的完成时间：任务 i 在它依赖的前驱任务都完成后立即开始
+    launch_finish = {}
+    task_finish = {}
+    for launch_id in sorted(launches):
+        l = launches[launch_id]
+        n = max(l.num_tasks, max(l.task_durations) + 1 if l.task_durations else 0)
+        all_ready = 0.0
+        windows = []
+        for dep, radius in l.deps:
+            if dep not in launch_finish:
+                continue
+            if radius < 0:
+                all_ready = max(all_ready, launch_finish[dep])
+            else:
+                windows.append((task_finish[dep], radius))
+        finishes = []
+        for i in range(n):
+            start = all_ready
+            for pred, radius in windows:
+                for j in range(max(0, i - radius), min(len(pred), i + radius + 1)):
+                    start = max(start, pred[j])
+            finishes.append(start + l.task_durations.get(i, 0.0))
+        task_finish[launch_id] = finishes
+        launch_finish[launch_id] = max(finishes) if finishes else all_ready
+    return max(launch_finish.values()) if launch_finish else 0.0
+
+
+def achieved_critical_path(launches, follow_submission):
+    # 从最后完成的启动往回走：每一步取最晚完成的前驱，直到启动的提交晚于所有前驱完成。
+    # follow_submission 时提交本身由前驱的完成触发 (同步 run())，继续沿前驱往回走
+    done = [l for l in launches.values() if l.complete is not None]
+    if not done:
+        return []
+    l = max(done, key=lambda x: x.complete)
+    path = []
+    while l is not None:
+        preds = [launches[d] for d, _ in l.deps
+                 if d in launches and launches[d].complete is not None]
+        binding = max(preds, key=lambda x: x.complete) if preds else None
+        if (binding is not None and not follow_submission and l.submit is not None
+                and binding.complete < l.submit):
+            binding = None
+        path.append((l, binding))
+        l = binding
+    path.reverse()
+    return path
+
+
+def slack(launches):
+    # 以每个启动实际的执行时间为权重，前向求最早完成，反向求最晚完成
+    ids = sorted(launches)
+    weight = {i: launches[i].execution() for i in ids}
+    earliest = {}
+    successors = {i: [] for i in ids}
+    for i in ids:
+        start = 0.0
+        for dep, _ in launches[i].deps:
+            if dep in earliest:
+                start = max(start, earliest[dep])
+                successors[dep].append(i)
+        earliest[i] = start + weight[i]
+    makespan = max(earliest.values()) if earliest else 0.0
+    latest = {}
+    for i in reversed(ids):
+        latest[i] = min([latest[s] - weight[s] for s in successors[i]] + [makespan])
+    return {i: latest[i] - earliest[i] for i in ids}, weight
+
+
+def parallelism_profile(spans, begin, end, buckets):
+    width = (end - begin) / buckets if end > begin else 1.0
+    busy = [0.0] * buckets
+    for start, stop, _ in spans:
+        for b in range(max(0, int((start - begin) / width)), min(buckets, int((stop - begin) / width) + 1)):
+            lo = begin + b * width
+            overlap = min(stop, lo + width) - max(start, lo)
+            if overlap > 0:
+                busy[b] += overlap
+    return width, [x / width for x in busy]
+
+
+if __name__ == '__main__':
+
+    # 设置脚本的功能描述
+    parser = argparse.ArgumentParser(
+        description='Analyze a task system trace written by runtasks --trace')
+    parser.add_argument('trace', help='Chrome trace JSON file written by runtasks --trace')
+    parser.add_argument('-w', '--workers', type=int, default=0,
+                        help='Number of workers (default: number of threads that ran tasks)')
+    parser.add_argument('-b', '--buckets', type=int, default=20,
+                        help='Number of time buckets of the parallelism profile (20 by default)')
+    parser.add_argument('--top', type=int, default=10,
+                        help='Number of least-slack launches to list (10 by default)')
+    parser.add_argument('--serial-launches', action='store_true',
+                        help='Treat each launch as depending on the previous one, as with a single thread calling run()')
+    args = parser.parse_args()
+
+    label, launches, spans = load_trace(args.trace)
+    if not spans:
+        print("%s: no task events in %s" % (label, args.trace))
+        sys.exit(1)
+    if args.serial_launches:
+        add_serial_deps(launches)
+    elif len(launches) > 1 and not any(l.deps for l in launches.values()):
+        print("note: the trace has no dependency events; use --serial-launches for traces of run()")
+
+    begin = min([s[0] for s in spans] + [l.submit for l in launches.values() if l.submit is not None])
+    end = max([s[1] for s in spans] + [l.complete for l in launches.values() if l.complete is not None])
+    elapsed = end - begin
+    workers = args.workers if args.workers > 0 else len(set(s[2] for s in spans))
+    work = sum(s[1] - s[0] for s in spans)
+    span = span_of_graph(launches)
+
+    print("==============================================================="
+          "=================")
+    print("Trace: %s (%s)" % (args.trace, label))
+    print("  launches: %d, tasks: %d, workers: %d" % (len(launches), len(spans), workers))
+    print("  elapsed: %.3f ms, work: %.3f ms, span: %.3f ms" % (elapsed / 1000, work / 1000, span / 1000))
+
+    # work/span 上界 ---------------------------------------------------------------------------------- start
+    print("==============================================================="
+          "=================")
+    parallelism = work / span if span > 0 else float('inf')
+    bound = max(work / workers, span)
+    print("Speedup bounds")
+    print("  ideal parallelism (work/span): %.2f" % parallelism)
+    print("  speedup bound on %d workers: %.2f" % (workers, min(workers, parallelism)))
+    print("  achieved speedup (work/elapsed): %.2f" % (work / elapsed))
+    print("  lower bound on elapsed time: %.3f ms (%s)" % (
+        bound / 1000, "span" if span >= work / workers else "work/workers"))
+    overhead = elapsed - bound
+    if elapsed <= 1.2 * bound:
+        print("  verdict: limited by the %s" % ("graph (span)" if span >= work / workers else "amount of work"))
+    else:
+        print("  verdict: limited by the scheduler (%.3f ms, %.0f%% of elapsed, above the bound)" % (
+            overhead / 1000, 100.0 * overhead / elapsed))
+    # work/span 上界 ---------------------------------------------------------------------------------- end
+
+    # 实际的关键路径 ------------------------------------------------------------------------------------ start
+    print("==============================================================="
+          "=================")
+    path = achieved_critical_path(launches, args.serial_launches)
+    # 把路径上的时间切成互不重叠的几段：每一段都从上一个启动完成的时刻开始截断，
+    # 这样任务级依赖下流水起来的启动不会被重复计算
+    submission = release = queue = execution = 0.0
+    covered = None
+    for l, binding in path:
+        t = binding.complete if binding is not None else (l.submit if l.submit is not None else begin)
+        if covered is not None:
+            t = max(t, covered)
+        # 任务级依赖下启动可能比前驱先记录完成，这样的启动不占用路径上的时间
+        if t >= l.complete:
+            continue
+        for point, kind in ((l.submit, 0), (l.ready, 1), (l.first_start, 2)):
+            point = min(max(t, point if point is not None else t), l.complete)
+            if kind == 0:
+                submission += point - t
+            elif kind == 1:
+                release += point - t
+            else:
+                queue += point - t
+            t = point
+        execution += l.complete - t
+        covered = l.complete
+    print("Achieved critical path: %d launches, %.3f ms" % (
+        len(path), (submission + release + queue + execution) / 1000))
+    if path:
+        ids = [str(l.id) for l, _ in path]
+        if len(ids) > 20:
+            ids = ids[:10] + ["..."] + ids[-10:]
+        print("  launches: %s" % " -> ".join(ids))
+        print("  submission (predecessor complete to submit): %.3f ms" % (submission / 1000))
+        print("  dependency release (to ready): %.3f ms" % (release / 1000))
+        print("  waiting for a worker (ready to first task start): %.3f ms" % (queue / 1000))
+        print("  execution (to complete): %.3f ms" % (execution / 1000))
+    # 实际的关键路径 ------------------------------------------------------------------------------------ end
+
+    # 并行度曲线 ---------------------------------------------------------------------------------------- start
+    print("==============================================================="
+          "=================")
+    width, profile = parallelism_profile(spans, begin, end, args.buckets)
+    print("Parallelism profile (%.3f ms per bucket, average %.2f)" % (width / 1000, work / elapsed))
+    for b, p in enumerate(profile):
+        bar = "#" * int(round(40.0 * p / workers)) if workers > 0 else ""
+        print("  %9.3f ms %6.2f |%s" % ((b * width) / 1000, p, bar))
+    # 并行度曲线 ---------------------------------------------------------------------------------------- end
+
+    # 每个启动的 slack ---------------------------------------------------------------------------------- start
+    print("==============================================================="
+          "=================")
+    slacks, weights = slack(launches)
+    values = sorted(slacks.values())
+    critical = [i for i in slacks if slacks[i] <= 1e-6]
+    print("Per-launch slack (launch weights are measured execution times)")
+    print("  zero-slack launches: %d of %d" % (len(critical), len(slacks)))
+    if values:
+        print("  slack min/median/max: %.3f / %.3f / %.3f ms" % (
+            values[0] / 1000, values[len(values) // 2] / 1000, values[-1] / 1000))
+    for i in sorted(slacks, key=lambda i: (slacks[i], -weights[i]))[:args.top]:
+        print("  launch %6d: slack %9.3f ms, execution %9.3f ms, %d tasks, %d deps" % (
+            i, slacks[i] / 1000, weights[i] / 1000, launches[i].num_tasks, len(launches[i].deps)))
+    # 每个启动的 slack ---------------------------------------------------------------------------------- end
+    print("==============================================================="
+          "=================")
@@ -2,20 +2,41 @@
 #include <stdio.h>
 #include <getopt.h>
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <assert.h>
 
 #include "tasksys.h"
+#include "tasksysimpls.h"
 #include "tests.h"
+#include "tasktrace.h"
+#include "benchstats.h"
 
 #define DEFAULT_NUM_THREADS 8
 #define DEFAULT_NUM_TIMING_ITERATIONS 3
+#define DEFAULT_NUM_WARMUP_ITERATIONS 0
+#define DEFAULT_REGRESSION_THRESHOLD 10.0
 
 
 void usage(const char* progname, std::string *testnames, int num_tests) {
-    printf("Usage: %s [options] testname\n", progname);
+    printf("Usage: %s [options] testname... | all\n", progname);
     printf("Program Options:\n");
     printf("  -n  --num_threads  <INT>      Number of threads: <INT> (default=%d)\n", DEFAULT_NUM_THREADS);
     printf("  -i  --num_timing_iterations <INT> Number of timing iterations: <INT> (default=%d)\n", DEFAULT_NUM_TIMING_ITERATIONS);
+    printf("  -w  --warmup <INT>            Untimed iterations run before the timed ones (default=%d)\n", DEFAULT_NUM_WARMUP_ITERATIONS);
+    printf("  -r  --reuse                   Run all iterations on one task system instead of a new one per iteration\n");
+    printf("  -j  --json <FILE>             Write the timing statistics of every test and task system to <FILE> as JSON\n");
+    printf("  -c  --csv <FILE>              Write the timing statistics to <FILE> as CSV\n");
+    printf("  -B  --save-baseline <FILE>    Save the timing statistics to <FILE> for later comparison (CSV, same as -c)\n");
+    printf("  -b  --baseline <FILE>         Compare the medians with a baseline saved by -B; exit with status 2 on regression\n");
+    printf("  -T  --threshold <PCT>         Slowdown of the median beyond which a comparison is a regression (default=%.0f)\n", DEFAULT_REGRESSION_THRESHOLD);
+    printf("  -P  --param <NAME>=<VALUE>    Set a workload parameter of the tests (repeatable); each test prints\n");
+    printf("                                the parameters it reads and their values\n");
+    printf("  -S  --sweep-threads <LIST>    Run every test at each thread count of the comma-separated <LIST>\n");
+    printf("                                and report speedup over Serial, parallel efficiency and the knee\n");
+    printf("  -s  --stats                   Print the task system's counters after the last iteration\n");
+    printf("  -t  --trace <PREFIX>          Write a Chrome trace of the last iteration of the n-th task system\n");
+    printf("                                to <PREFIX>_<n>.json (SIGUSR1 dumps to <PREFIX>_signal.json)\n");
     printf("  -?  --help                    This message\n");
     printf("Valid testnames are:");
     for(int i = 0; i < num_tests; i++) {
@@ -23,35 +44,347 @@ void usage(const char* progname, std::string *testnames, int num_tests) {
     }
 }
 
-enum TaskSystemType {
-    SERIAL,
-    PARALLEL_SPAWN,
-    PARALLEL_THREAD_POOL_SPINNING,
-    PARALLEL_THREAD_POOL_SLEEPING,
-    N_TASKSYS_IMPLS, // This must be in the last position.
+/*
+ * Prints the counters of `t` (see ITaskSystem::stats()): one line per
+ * worker, how unevenly busy time was spread over the workers, and the
+ * system-wide counters.
+ */
+void printStats(ITaskSystem* t) {
+    TaskSystemStats stats = t->stats();
+    if (!stats.workers.empty()) {
+        printf("  worker     tasks    chunks  steals ok/tried   wakeups  launches   busy ms   spin ms parked ms\n");
+        WorkerStats total;
+        double max_busy = 0;
+        for (size_t i = 0; i < stats.workers.size(); i++) {
+            const WorkerStats& w = stats.workers[i];
+            printf("  %6d %9lld %9lld %7lld/%-7lld %9lld %9lld %9.3f %9.3f %9.3f\n",
+                   (int)i, w.tasks_executed, w.chunks_claimed, w.steals_succeeded,
+                   w.steals_attempted, w.wakeups, w.launches_completed,
+                   w.busy_seconds * 1000, w.spinning_seconds * 1000, w.parked_seconds * 1000);
+            total.add(w);
+            max_busy = std::max(max_busy, w.busy_seconds);
+        }
+        printf("  %6s %9lld %9lld %7lld/%-7lld %9lld %9lld %9.3f %9.3f %9.3f\n",
+               "total", total.tasks_executed, total.chunks_claimed, total.steals_succeeded,
+               total.steals_attempted, total.wakeups, total.launches_completed,
+               total.busy_seconds * 1000, total.spinning_seconds * 1000, total.parked_seconds * 1000);
+        double mean_busy = total.busy_seconds / stats.workers.size();
+        if (mean_busy > 0) {
+            printf("  imbalance (max/mean busy): %.2f\n", max_busy / mean_busy);
+        }
+    }
+    printf("  arena: %zu bytes reserved, %zu peak in use, %lld allocations, %lld resets\n",
+           stats.arena.bytes_reserved, stats.arena.peak_bytes_in_use,
+           stats.arena.allocations, stats.arena.resets);
+    printf("  deps: %lld kept, pruned %lld completed, %lld duplicate, %lld transitive\n",
+           stats.dep_pruning.kept, stats.dep_pruning.completed,
+           stats.dep_pruning.duplicate, stats.dep_pruning.transitive);
+    printf("  wake-ups: %lld launches, %lld wake-ups, %lld spurious\n",
+           stats.wakeup.launches, stats.wakeup.wakeups, stats.wakeup.spurious_wakeups);
+}
+
+struct BenchOptions {
+    int num_threads;
+    int num_timing_iterations;
+    int num_warmup_iterations;
+    // run every iteration on one task system instead of a fresh one
+    bool reuse;
+    bool print_stats;
+    std::string trace_prefix;
+};
+
+/*
+ * Timing statistics of one test on one task system, in ms.
+ */
+struct BenchResult {
+    std::string test;
+    std::string impl;
+    int num_threads;
+    // workload parameters the test read, "name=value ..."
+    std::string params;
+    SampleStats stats;
+    // bandwidth at the median time, for tests that report the bytes
+    // they move (0 for the others)
+    double gb_per_s;
 };
 
-ITaskSystem *selectTaskSystemRefImpl(int num_threads, TaskSystemType type) {
-    assert(type < N_TASKSYS_IMPLS);
+/*
+ * Runs `test` on task system `type`: the warm-up iterations, whose times
+ * are dropped, then the timed iterations.  Exits if any run fails its
+ * correctness check.  Prints the minimum time (the line
+ * run_test_harness.py reads) followed by the other statistics.
+ */
+BenchResult benchmark(const std::string& test_name, TestResults (*test)(ITaskSystem*),
+                      TaskSystemType type, const BenchOptions& options) {
+    BenchResult result;
+    result.test = test_name;
+    result.num_threads = options.num_threads;
+    result.gb_per_s = 0;
+    std::vector<double> samples;
+    double bytes = 0;
+    int num_iterations = options.num_warmup_iterations + options.num_timing_iterations;
+    ITaskSystem *t = NULL;
+    WorkloadParams::clearUsed();
+    for (int j = 0; j < num_iterations; j++) {
+        bool last_iteration = j + 1 == num_iterations;
+
+        // Keep only the trace of the last iteration
+        if (!options.trace_prefix.empty() && last_iteration) {
+            TaskTrace::clear();
+        }
+
+        // Create a new task system, unless reusing the previous one
+        if (t == NULL) {
+            t = selectTaskSystemRefImpl(options.num_threads, type);
+        }
+        result.impl = t->name();
+
+        // Run test
+        TestResults run = test(t);
+
+        // Check that the test result was correct
+        if (!run.passed) {
+            printf("ERROR: Results did not pass correctness check! (iter=%d, ref_impl=%s)\n",
+                j, t->name());
+            exit(1);
+        }
+
+        if (j >= options.num_warmup_iterations) {
+            samples.push_back(run.time * 1000);
+        }
+        result.params = WorkloadParams::used();
+        bytes = run.bytes;
+
+        if (last_iteration) {
+            result.stats = summarize(samples);
+            const SampleStats& s = result.stats;
+            printf("[%s]:\t\t[%.3f] ms\n", t->name(), s.min);
+            printf("  median %.3f ms, mean %.3f +/- %.3f ms (95%% CI), stddev %.3f ms, p95 %.3f ms, %d runs\n",
+                   s.median, s.mean, s.ci95, s.stddev, s.p95, s.n);
+            if (bytes > 0 && s.min > 0) {
+                result.gb_per_s = bytes / (s.median * 1e6);
+                printf("  bandwidth %.2f GB/s (median), %.2f GB/s (best)\n",
+                       result.gb_per_s, bytes / (s.min * 1e6));
+            }
+            if (options.print_stats) {
+                printStats(t);
+            }
+        }
+
+        // Shutdown task system so each timing run is from a clean start
+        if (!options.reuse || last_iteration) {
+            delete t;
+            t = NULL;
+        }
+    }
+
+    if (!options.trace_prefix.empty()) {
+        std::string path = options.trace_prefix + "_" + std::to_string((int)type) + ".json";
+        if (TaskTrace::dump(path.c_str(), result.impl.c_str())) {
+            printf("[%s]:\t\ttrace written to %s\n", result.impl.c_str(), path.c_str());
+        } else {
+            fprintf(stderr, "Error: could not write %s\n", path.c_str());
+        }
+    }
+    return result;
+}
+
+/*
+ * Parses a comma-separated list of positive integers such as "1,2,4,8".
+ * Returns false if `list` is not one.
+ */
+bool parseIntList(const char* list, std::vector<int>* values) {
+    values->clear();
+    const char* p = list;
+    while (*p) {
+        char* end;
+        long value = strtol(p, &end, 10);
+        if (end == p || value <= 0 || (*end != ',' && *end != '\0')) {
+            return false;
+        }
+        values->push_back((int)value);
+        p = *end == ',' ? end + 1 : end;
+    }
+    return !values->empty();
+}
+
+/*
+ * Prints how each parallel task system of one test scales over the
+ * thread counts of a sweep: median time, speedup over Serial (median
+ * over median) and parallel efficiency (speedup / threads).  The knee is
+ * the fewest threads that reach 90% of the best speedup the task system
+ * achieved; threads beyond it buy little.  `thread_counts` must be in
+ * ascending order.
+ */
+void printScaling(const std::vector<BenchResult>& results, const std::vector<int>& thread_counts) {
+    const BenchResult* serial = NULL;
+    for (const BenchResult& r : results) {
+        if (r.impl == "Serial") {
+            serial = &r;
+        }
+    }
+    if (serial == NULL || serial->stats.median <= 0) {
+        return;
+    }
+    printf("Scaling over [Serial] (median %.3f ms):\n", serial->stats.median);
+    std::vector<std::string> impls;
+    for (const BenchResult& r : results) {
+        if (&r != serial && std::find(impls.begin(), impls.end(), r.impl) == impls.end()) {
+            impls.push_back(r.impl);
+        }
+    }
+    for (const std::string& impl : impls) {
+        printf("[%s]:\n", impl.c_str());
+        printf("  threads  median ms   speedup  efficiency\n");
+        std::vector<std::pair<int, double> > speedups;
+        for (int n : thread_counts) {
+            for (const BenchResult& r : results) {
+                if (r.impl != impl || r.num_threads != n || r.stats.median <= 0) {
+                    continue;
+                }
+                double speedup = serial->stats.median / r.stats.median;
+                printf("  %7d %10.3f %8.2fx %10.0f%%\n", n, r.stats.median, speedup, 100 * speedup / n);
+                speedups.push_back(std::make_pair(n, speedup));
+            }
+        }
+        double best = 0;
+        for (const std::pair<int, double>& p : speedups) {
+            best = std::max(best, p.second);
+        }
+        for (const std::pair<int, double>& p : speedups) {
+            if (p.second >= 0.9 * best) {
+                printf("  knee: %d threads (%.2fx of best %.2fx)\n", p.first, p.second, best);
+                break;
+            }
+        }
+    }
+}
 
-    if (type == SERIAL) {
-        return new TaskSystemSerial(num_threads);
-    } else if (type == PARALLEL_SPAWN) {
-        return new TaskSystemParallelSpawn(num_threads);
-    } else if (type == PARALLEL_THREAD_POOL_SPINNING) {
-        return new TaskSystemParallelThreadPoolSpinning(num_threads);
-    } else if (type == PARALLEL_THREAD_POOL_SLEEPING) {
-        return new TaskSystemParallelThreadPoolSleeping(num_threads);
-    } else {
-        return NULL;
+/*
+ * Reads results written by writeCsv().  Returns false if `path` cannot
+ * be opened.
+ */
+bool readCsv(const char* path, std::vector<BenchResult>* results) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    char line[2048];
+    char test_name[256];
+    char impl[256];
+    char params[1024];
+    while (fgets(line, sizeof(line), f)) {
+        BenchResult r;
+        SampleStats& s = r.stats;
+        params[0] = '\0';
+        if (sscanf(line, "%255[^,],\"%255[^\"]\",%d,%d,%lf,%lf,%lf,%lf,%lf,%lf,%lf,\"%1023[^\"]\"",
+                   test_name, impl, &r.num_threads, &s.n, &s.min, &s.median, &s.mean,
+                   &s.stddev, &s.p95, &s.max, &s.ci95, params) < 11) {
+            continue;   // header or malformed line
+        }
+        r.test = test_name;
+        r.impl = impl;
+        r.params = params;
+        results->push_back(r);
+    }
+    fclose(f);
+    return true;
+}
+
+/*
+ * Compares `results` with `baseline`, matching test, task system,
+ * thread count and workload parameters.  A change of the median is significant when it exceeds
+ * `threshold_percent` and the 95% confidence intervals of the two means
+ * do not overlap (runs of a single iteration have no interval, so only
+ * the threshold applies).  Returns the number of significant slowdowns.
+ */
+int compareWithBaseline(const std::vector<BenchResult>& results, const std::vector<BenchResult>& baseline,
+                        double threshold_percent) {
+    int regressions = 0;
+    printf("Comparison with baseline (medians, threshold %.1f%%):\n", threshold_percent);
+    printf("  %-45s %-32s %7s %12s %12s %8s  %s\n",
+           "test", "task system", "threads", "baseline ms", "current ms", "delta", "verdict");
+    for (const BenchResult& r : results) {
+        const BenchResult* base = NULL;
+        for (const BenchResult& b : baseline) {
+            if (b.test == r.test && b.impl == r.impl && b.num_threads == r.num_threads &&
+                b.params == r.params) {
+                base = &b;
+            }
+        }
+        if (base == NULL || base->stats.median <= 0) {
+            printf("  %-45s %-32s %7d %12s %12.3f %8s  new\n",
+                   r.test.c_str(), r.impl.c_str(), r.num_threads, "-", r.stats.median, "-");
+            continue;
+        }
+        double delta = (r.stats.median - base->stats.median) / base->stats.median * 100;
+        bool outside_noise = fabs(r.stats.mean - base->stats.mean) > r.stats.ci95 + base->stats.ci95;
+        const char* verdict = "ok";
+        if (delta > threshold_percent && outside_noise) {
+            verdict = "REGRESSION";
+            regressions++;
+        } else if (delta < -threshold_percent && outside_noise) {
+            verdict = "improvement";
+        } else if (fabs(delta) > threshold_percent) {
+            verdict = "ok (within noise)";
+        }
+        printf("  %-45s %-32s %7d %12.3f %12.3f %+7.1f%%  %s\n",
+               r.test.c_str(), r.impl.c_str(), r.num_threads, base->stats.median, r.stats.median,
+               delta, verdict);
     }
+    return regressions;
+}
+
+bool writeJson(const char* path, const std::vector<BenchResult>& results, const BenchOptions& options) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "{\"num_timing_iterations\":%d,\"num_warmup_iterations\":%d,\"reuse\":%s,\"results\":[",
+            options.num_timing_iterations, options.num_warmup_iterations, options.reuse ? "true" : "false");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        const SampleStats& s = r.stats;
+        fprintf(f, "%s\n{\"test\":\"%s\",\"impl\":\"%s\",\"num_threads\":%d,\"runs\":%d,"
+                "\"min_ms\":%.6f,\"median_ms\":%.6f,\"mean_ms\":%.6f,\"stddev_ms\":%.6f,"
+                "\"p95_ms\":%.6f,\"max_ms\":%.6f,\"ci95_ms\":%.6f,\"params\":\"%s\",\"gb_per_s\":%.3f}",
+                i == 0 ? "" : ",", r.test.c_str(), r.impl.c_str(), r.num_threads, s.n,
+                s.min, s.median, s.mean, s.stddev, s.p95, s.max, s.ci95, r.params.c_str(), r.gb_per_s);
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0;
+}
+
+bool writeCsv(const char* path, const std::vector<BenchResult>& results) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "test,impl,num_threads,runs,min_ms,median_ms,mean_ms,stddev_ms,p95_ms,max_ms,ci95_ms,params,gb_per_s\n");
+    for (const BenchResult& r : results) {
+        const SampleStats& s = r.stats;
+        fprintf(f, "%s,\"%s\",%d,%d,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,\"%s\",%.3f\n",
+                r.test.c_str(), r.impl.c_str(), r.num_threads, s.n,
+                s.min, s.median, s.mean, s.stddev, s.p95, s.max, s.ci95, r.params.c_str(), r.gb_per_s);
+    }
+    return fclose(f) == 0;
 }
 
 int main(int argc, char** argv)
 {
-    const int n_tests = 31;
-    int num_threads = DEFAULT_NUM_THREADS;
-    int num_timing_iterations = DEFAULT_NUM_TIMING_ITERATIONS;
+    const int n_tests = 69;
+    BenchOptions options;
+    options.num_threads = DEFAULT_NUM_THREADS;
+    options.num_timing_iterations = DEFAULT_NUM_TIMING_ITERATIONS;
+    options.num_warmup_iterations = DEFAULT_NUM_WARMUP_ITERATIONS;
+    options.reuse = false;
+    options.print_stats = false;
+    std::string json_path;
+    std::string csv_path;
+    std::vector<int> sweep_threads;
+    std::string save_baseline_path;
+    std::string baseline_path;
+    double regression_threshold = DEFAULT_REGRESSION_THRESHOLD;
 
     TestResults (*test[n_tests])(ITaskSystem*) = {
         simpleTestSync,
@@ -83,6 +416,44 @@ int main(int argc, char** argv)
         strictGraphDepsSmall,
         strictGraphDepsMedium,
         strictGraphDepsLarge,
+        continuationLatencyThenTest,
+        continuationLatencySyncTest,
+        pingPongUnequalTaskDepsTest,
+        stencilBarrierAsyncTest,
+        stencilWavefrontAsyncTest,
+        eventDepsTest,
+        pipelineTest,
+        pipelineLaunchPerStageAsyncTest,
+        scratchBufferArenaTest,
+        scratchBufferNewTest,
+        scratchBufferArenaAlignedTest,
+        scratchBufferArenaAsyncTest,
+        strictGraphDepsAllocFreeTest,
+        strictGraphDepsLargeBatch,
+        strictGraphDepsLargePruned,
+        concurrentRunTest,
+        wakeupsPerLaunchTest,
+        skewedParetoTest,
+        skewedParetoAsyncTest,
+        skewedLognormalTest,
+        skewedLognormalAsyncTest,
+        skewedBimodalTest,
+        skewedBimodalAsyncTest,
+        skewedLastTaskTest,
+        skewedLastTaskAsyncTest,
+        streamCopyTest,
+        streamCopyAsyncTest,
+        streamScaleTest,
+        streamScaleAsyncTest,
+        streamAddTest,
+        streamAddAsyncTest,
+        streamTriadTest,
+        streamTriadAsyncTest,
+        dagChainTest,
+        dagFanOutFanInTest,
+        dagWavefront2DTest,
+        dagButterflyTest,
+        dagUnbalancedTreeTest,
     };
 
     std::string test_names[n_tests] = {
@@ -115,6 +486,44 @@ int main(int argc, char** argv)
         "strict_graph_deps_small_async",
         "strict_graph_deps_med_async",
         "strict_graph_deps_large_async",
+        "continuation_latency_then",
+        "continuation_latency_sync",
+        "ping_pong_unequal_task_deps_async",
+        "stencil_barrier_async",
+        "stencil_wavefront_async",
+        "event_deps_async",
+        "pipeline",
+        "pipeline_launch_per_stage_async",
+        "scratch_buffer_arena",
+        "scratch_buffer_new",
+        "scratch_buffer_arena_aligned",
+        "scratch_buffer_arena_async",
+        "strict_graph_deps_large_alloc_free_async",
+        "strict_graph_deps_large_batch_async",
+        "strict_graph_deps_large_pruned_async",
+        "concurrent_run",
+        "wakeups_per_launch",
+        "skewed_pareto",
+        "skewed_pareto_async",
+        "skewed_lognormal",
+        "skewed_lognormal_async",
+        "skewed_bimodal",
+        "skewed_bimodal_async",
+        "skewed_last_task",
+        "skewed_last_task_async",
+        "stream_copy",
+        "stream_copy_async",
+        "stream_scale",
+        "stream_scale_async",
+        "stream_add",
+        "stream_add_async",
+        "stream_triad",
+        "stream_triad_async",
+        "dag_chain",
+        "dag_fan_out_fan_in",
+        "dag_wavefront_2d",
+        "dag_butterfly",
+        "dag_unbalanced_tree",
     };
  
     // Parse commandline options
@@ -122,17 +531,81 @@ int main(int argc, char** argv)
     static struct option long_options[] = {
         {"num_threads",           1, 0,  'n'},
         {"num_timing_iterations", 1, 0,  'i'},
+        {"warmup",                1, 0,  'w'},
+        {"reuse",                 0, 0,  'r'},
+        {"json",                  1, 0,  'j'},
+        {"csv",                   1, 0,  'c'},
+        {"save-baseline",         1, 0,  'B'},
+        {"baseline",              1, 0,  'b'},
+        {"threshold",             1, 0,  'T'},
+        {"param",                 1, 0,  'P'},
+        {"sweep-threads",         1, 0,  'S'},
+        {"stats",                 0, 0,  's'},
+        {"trace",                 1, 0,  't'},
         {"help",                  0, 0,  '?'},
+        {0, 0, 0, 0},
     };
 
-    while ((opt = getopt_long(argc, argv, "n:i:?", long_options, NULL)) != EOF) {
+    while ((opt = getopt_long(argc, argv, "n:i:w:rj:c:B:b:T:P:S:st:?", long_options, NULL)) != EOF) {
 
         switch (opt) {
         case 'n':
-            num_threads = atoi(optarg);
+            options.num_threads = atoi(optarg);
             break;
         case 'i':
-            num_timing_iterations = atoi(optarg);
+            options.num_timing_iterations = atoi(optarg);
+            break;
+        case 'w':
+            options.num_warmup_iterations = atoi(optarg);
+            break;
+        case 'r':
+            options.reuse = true;
+            break;
+        case 'j':
+            json_path = optarg;
+            break;
+        case 'c':
+            csv_path = optarg;
+            break;
+        case 'B':
+            save_baseline_path = optarg;
+            break;
+        case 'b':
+            baseline_path = optarg;
+            break;
+        case 'T':
+            regression_threshold = atof(optarg);
+            break;
+        case 'P': {
+            std::string param = optarg;
+            size_t eq = param.find('=');
+            char* end = NULL;
+            double value = eq == std::string::npos ? 0 : strtod(param.c_str() + eq + 1, &end);
+            if (eq == std::string::npos || eq == 0 || end == param.c_str() + eq + 1 || *end != '\0') {
+                fprintf(stderr, "Error: invalid parameter %s, expected NAME=VALUE!\n", optarg);
+                usage(argv[0], test_names, n_tests);
+                return 1;
+            }
+            WorkloadParams::set(param.substr(0, eq), value);
+            break;
+        }
+        case 'S':
+            if (!parseIntList(optarg, &sweep_threads)) {
+                fprintf(stderr, "Error: invalid thread count list %s!\n", optarg);
+                usage(argv[0], test_names, n_tests);
+                return 1;
+            }
+            // The sweep and its knee go from the fewest threads up,
+            // whatever order the counts were given in
+            std::sort(sweep_threads.begin(), sweep_threads.end());
+            sweep_threads.erase(std::unique(sweep_threads.begin(), sweep_threads.end()),
+                                sweep_threads.end());
+            break;
+        case 's':
+            options.print_stats = true;
+            break;
+        case 't':
+            options.trace_prefix = optarg;
             break;
         case '?':
         default:
@@ -147,57 +620,111 @@ int main(int argc, char** argv)
         return 1;
     }
 
-    std::string test_name = argv[optind];
+    if (options.num_timing_iterations < 1 || options.num_warmup_iterations < 0) {
+        fprintf(stderr, "Error: need at least one timing iteration and no negative warm-up!\n");
+        usage(argv[0], test_names, n_tests);
+        return 1;
+    }
+
+    // Read the baseline up front so a bad path fails before the tests run
+    std::vector<BenchResult> baseline;
+    if (!baseline_path.empty() && !readCsv(baseline_path.c_str(), &baseline)) {
+        fprintf(stderr, "Error: could not read baseline %s\n", baseline_path.c_str());
+        return 1;
+    }
 
-    bool found = false;
-    for (int test_id = 0; test_id < n_tests; test_id++) {
-        if (test_names[test_id].compare(test_name) != 0) {
-            continue;
+    // Tests named on the command line, in order; "all" selects every test
+    std::vector<int> selected;
+    for (int arg = optind; arg < argc; arg++) {
+        std::string test_name = argv[arg];
+        bool found = false;
+        for (int test_id = 0; test_id < n_tests; test_id++) {
+            // n_tests may leave unused slots at the end of the tables
+            if (test[test_id] == NULL) {
+                continue;
+            }
+            if (test_name == "all" || test_names[test_id] == test_name) {
+                selected.push_back(test_id);
+                found = true;
+            }
         }
+        if (!found) {
+            fprintf(stderr, "Error: invalid test_name %s!\n", test_name.c_str());
+            usage(argv[0], test_names, n_tests);
+            return 1;
+        }
+    }
 
-        found = true;
+    // Tracing stays on for the whole run; the ring buffers keep the latest events.
+    if (!options.trace_prefix.empty()) {
+        TaskTrace::dumpOnSignal((options.trace_prefix + "_signal.json").c_str());
+    }
+
+    std::vector<BenchResult> results;
+    for (int test_id : selected) {
         printf("============================================================="
                "======================\n");
         printf("Test name: %s\n", test_names[test_id].c_str());
         printf("============================================================="
                "======================\n");
 
-        for (int i = 0; i < N_TASKSYS_IMPLS; i++) {
-            double minT = 1e30;
-            for (int j = 0; j < num_timing_iterations; j++) {
-
-                // Create a new task system
-                ITaskSystem *t = selectTaskSystemRefImpl(num_threads, (TaskSystemType) i);
-
-                // Run test
-                TestResults result = test[test_id](t);
-
-                // Check that the test result was correct
-                if (!result.passed) {
-                    printf("ERROR: Results did not pass correctness check! (iter=%d, ref_impl=%s)\n",
-                        j, t->name());
-                    exit(1);
-                }
-
-                minT = std::min(minT, result.time);
-
-                // TODO: do this better
-                if( j+1 == num_timing_iterations) {
-                    printf("[%s]:\t\t[%.3f] ms\n", t->name(), minT * 1000);
+        if (sweep_threads.empty()) {
+            for (int i = 0; i < N_TASKSYS_IMPLS; i++) {
+                results.push_back(benchmark(test_names[test_id], test[test_id], (TaskSystemType) i, options));
+            }
+        } else {
+            // Serial does not depend on the thread count: run it once, as
+            // the baseline of the speedups
+            std::vector<BenchResult> sweep;
+            for (size_t k = 0; k < sweep_threads.size(); k++) {
+                BenchOptions sweep_options = options;
+                sweep_options.num_threads = sweep_threads[k];
+                printf("Threads: %d\n", sweep_threads[k]);
+                for (int i = (k == 0 ? 0 : SERIAL + 1); i < N_TASKSYS_IMPLS; i++) {
+                    sweep.push_back(benchmark(test_names[test_id], test[test_id], (TaskSystemType) i, sweep_options));
                 }
-
-                // Shutdown task system so each timing run is from a clean start
-                delete t;
             }
+            printf("============================================================="
+                   "======================\n");
+            printScaling(sweep, sweep_threads);
+            results.insert(results.end(), sweep.begin(), sweep.end());
+        }
+        if (!results.empty() && !results.back().params.empty()) {
+            printf("Parameters: %s\n", results.back().params.c_str());
         }
         printf("============================================================="
                "======================\n");
     }
-    if (!found) {
-        fprintf(stderr, "Error: invalid test_name!\n");
-        usage(argv[0], test_names, n_tests);
+
+    for (const std::string& name : WorkloadParams::unread()) {
+        fprintf(stderr, "Warning: parameter %s is not used by the selected tests\n", name.c_str());
+    }
+
+    if (!json_path.empty() && !writeJson(json_path.c_str(), results, options)) {
+        fprintf(stderr, "Error: could not write %s\n", json_path.c_str());
         return 1;
     }
+    if (!csv_path.empty() && !writeCsv(csv_path.c_str(), results)) {
+        fprintf(stderr, "Error: could not write %s\n", csv_path.c_str());
+        return 1;
+    }
+    if (!save_baseline_path.empty()) {
+        if (!writeCsv(save_baseline_path.c_str(), results)) {
+            fprintf(stderr, "Error: could not write %s\n", save_baseline_path.c_str());
+            return 1;
+        }
+        printf("Baseline saved to %s\n", save_baseline_path.c_str());
+    }
+
+    if (!baseline_path.empty()) {
+        int regressions = compareWithBaseline(results, baseline, regression_threshold);
+        printf("============================================================="
+               "======================\n");
+        if (regressions > 0) {
+            printf("%d regression(s) against %s\n", regressions, baseline_path.c_str());
+            return 2;
+        }
+    }
 
     return 0;
 }
@@ -0,0 +1,319 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+#include "tasksys.h"
+#include "tasksysimpls.h"
+#include "CycleTimer.h"
+#include "latencyhistogram.h"
+
+/*
+ * Microbenchmarks of task system overheads.  Every task is empty, so the
+ * times below are the cost of the scheduler alone:
+ *
+ *  - roundtrip: latency of run() with a single task
+ *  - tasks:     latency of run() as num_total_tasks grows
+ *  - wake:      time from run() to the first task starting, after the
+ *               caller slept long enough for the workers to park
+ *  - chain:     latency per launch of a chain of runAsyncWithDeps()
+ *               launches, each depending on the previous one
+ *  - submit:    cost of runAsyncWithDeps() and launches per second, for
+ *               many independent launches submitted back to back
+ *
+ * Latencies are kept in log-linear histograms (common/latencyhistogram.h)
+ * and reported as percentiles.
+ */
+
+#define DEFAULT_NUM_THREADS 8
+#define DEFAULT_NUM_SAMPLES 2000
+#define DEFAULT_MAX_TASKS 1024
+#define DEFAULT_CHAIN_LENGTH 100
+#define DEFAULT_PARK_USEC 2000
+
+struct MicrobenchOptions {
+    int num_threads;
+    int num_samples;
+    int max_tasks;
+    int chain_length;
+    int park_usec;
+    // print the whole percentile distribution of every histogram
+    bool distribution;
+};
+
+class NoopTask : public IRunnable {
+    public:
+        void runTask(int task_id, int num_total_tasks) {}
+};
+
+/*
+ * Counts the tasks that ran, so benchmarks of asynchronous launches can
+ * tell a task system that does not implement them.
+ */
+class CountingTask : public IRunnable {
+    public:
+        std::atomic<long long> runs;
+        CountingTask(): runs(0) {}
+        void runTask(int task_id, int num_total_tasks) {
+            runs.fetch_add(1, std::memory_order_relaxed);
+        }
+};
+
+/*
+ * Records when the first of its tasks started.
+ */
+class FirstStartTask : public IRunnable {
+    public:
+        std::atomic<CycleTimer::SysClock> first_start;
+        FirstStartTask(): first_start(0) {}
+        void runTask(int task_id, int num_total_tasks) {
+            if (first_start.load(std::memory_order_relaxed) == 0) {
+                CycleTimer::SysClock expected = 0;
+                first_start.compare_exchange_strong(expected, CycleTimer::currentTicks());
+            }
+        }
+};
+
+static long long ticksToNanoseconds(CycleTimer::SysClock ticks) {
+    return (long long)(ticks * CycleTimer::secondsPerTick() * 1e9);
+}
+
+static void report(const LatencyHistogram& histogram, const char* label, const MicrobenchOptions& options) {
+    histogram.printSummary(label, 1000, "us");
+    if (options.distribution) {
+        histogram.printDistribution(1000);
+    }
+}
+
+void benchRoundTrip(ITaskSystem* t, const MicrobenchOptions& options) {
+    NoopTask task;
+    LatencyHistogram histogram;
+    for (int i = 0; i < options.num_samples / 10; i++) {
+        t->run(&task, 1);
+    }
+    for (int i = 0; i < options.num_samples; i++) {
+        CycleTimer::SysClock start = CycleTimer::currentTicks();
+        t->run(&task, 1);
+        histogram.record(ticksToNanoseconds(CycleTimer::currentTicks() - start));
+    }
+    report(histogram, "run(), 1 task", options);
+}
+
+void benchTaskCount(ITaskSystem* t, const MicrobenchOptions& options) {
+    NoopTask task;
+    for (int num_tasks = 1; num_tasks <= options.max_tasks; num_tasks *= 4) {
+        LatencyHistogram histogram;
+        for (int i = 0; i < options.num_samples / 10; i++) {
+            t->run(&task, num_tasks);
+        }
+        for (int i = 0; i < options.num_samples; i++) {
+            CycleTimer::SysClock start = CycleTimer::currentTicks();
+            t->run(&task, num_tasks);
+            histogram.record(ticksToNanoseconds(CycleTimer::currentTicks() - start));
+        }
+        std::string label = "run(), " + std::to_string(num_tasks) + (num_tasks == 1 ? " task" : " tasks");
+        report(histogram, label.c_str(), options);
+    }
+}
+
+void benchWake(ITaskSystem* t, const MicrobenchOptions& options) {
+    LatencyHistogram histogram;
+    // Each sample sleeps, so take fewer of them
+    int num_samples = std::max(1, options.num_samples / 10);
+    for (int i = 0; i < num_samples; i++) {
+        FirstStartTask task;
+        usleep(options.park_usec);
+        CycleTimer::SysClock start = CycleTimer::currentTicks();
+        t->run(&task, options.num_threads);
+        histogram.record(ticksToNanoseconds(task.first_start.load() - start));
+    }
+    std::string label = "wake after " + std::to_string(options.park_usec) + " us idle";
+    report(histogram, label.c_str(), options);
+}
+
+void benchChain(ITaskSystem* t, const MicrobenchOptions& options) {
+    CountingTask task;
+    LatencyHistogram histogram;
+    std::vector<TaskID> no_deps;
+    std::vector<TaskID> deps(1);
+    int num_chains = std::max(1, options.num_samples / 10);
+    for (int i = 0; i < num_chains; i++) {
+        CycleTimer::SysClock start = CycleTimer::currentTicks();
+        deps[0] = t->runAsyncWithDeps(&task, 1, no_deps);
+        for (int k = 1; k < options.chain_length; k++) {
+            deps[0] = t->runAsyncWithDeps(&task, 1, deps);
+        }
+        t->sync();
+        histogram.record(ticksToNanoseconds(CycleTimer::currentTicks() - start) / options.chain_length);
+    }
+    if (task.runs.load() != (long long)num_chains * options.chain_length) {
+        printf("  chain: not supported (asynchronous launches did not run)\n");
+        return;
+    }
+    std::string label = "chain of " + std::to_string(options.chain_length) + ", per launch";
+    report(histogram, label.c_str(), options);
+}
+
+void benchSubmit(ITaskSystem* t, const MicrobenchOptions& options) {
+    CountingTask task;
+    LatencyHistogram histogram;
+    std::vector<TaskID> no_deps;
+    int num_launches = options.num_samples * 10;
+    CycleTimer::SysClock start = CycleTimer::currentTicks();
+    for (int i = 0; i < num_launches; i++) {
+        CycleTimer::SysClock submit = CycleTimer::currentTicks();
+        t->runAsyncWithDeps(&task, 1, no_deps);
+        histogram.record(ticksToNanoseconds(CycleTimer::currentTicks() - submit));
+    }
+    CycleTimer::SysClock submitted = CycleTimer::currentTicks();
+    t->sync();
+    CycleTimer::SysClock done = CycleTimer::currentTicks();
+    if (task.runs.load() != num_launches) {
+        printf("  submit: not supported (asynchronous launches did not run)\n");
+        return;
+    }
+    report(histogram, "runAsyncWithDeps(), no deps", options);
+    double submit_seconds = (submitted - start) * CycleTimer::secondsPerTick();
+    double total_seconds = (done - start) * CycleTimer::secondsPerTick();
+    printf("  %-28s %.0f launches/s submitted, %.0f launches/s completed\n", "throughput",
+           num_launches / submit_seconds, num_launches / total_seconds);
+}
+
+struct Microbench {
+    const char* name;
+    void (*run)(ITaskSystem*, const MicrobenchOptions&);
+};
+
+void usage(const char* progname, const Microbench* benches, int num_benches) {
+    printf("Usage: %s [options] [benchmark...]\n", progname);
+    printf("Program Options:\n");
+    printf("  -n  --num_threads <INT>       Number of threads: <INT> (default=%d)\n", DEFAULT_NUM_THREADS);
+    printf("  -s  --samples <INT>           Samples per latency histogram (default=%d)\n", DEFAULT_NUM_SAMPLES);
+    printf("  -m  --max_tasks <INT>         Largest num_total_tasks of the tasks benchmark (default=%d)\n", DEFAULT_MAX_TASKS);
+    printf("  -l  --chain_length <INT>      Launches per chain of the chain benchmark (default=%d)\n", DEFAULT_CHAIN_LENGTH);
+    printf("  -p  --park_usec <INT>         Idle time before each sample of the wake benchmark (default=%d)\n", DEFAULT_PARK_USEC);
+    printf("  -x  --impl <INT>              Only measure the task system with this index (default: all)\n");
+    printf("  -d  --distribution            Print the full percentile distribution of every histogram\n");
+    printf("  -?  --help                    This message\n");
+    printf("Benchmarks (default: all):");
+    for (int i = 0; i < num_benches; i++) {
+        printf(" %s%c", benches[i].name, (char)((i+1 == num_benches) ? '\n' : ','));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const Microbench benches[] = {
+        {"roundtrip", benchRoundTrip},
+        {"tasks", benchTaskCount},
+        {"wake", benchWake},
+        {"chain", benchChain},
+        {"submit", benchSubmit},
+    };
+    const int num_benches = sizeof(benches) / sizeof(benches[0]);
+
+    MicrobenchOptions options;
+    options.num_threads = DEFAULT_NUM_THREADS;
+    options.num_samples = DEFAULT_NUM_SAMPLES;
+    options.max_tasks = DEFAULT_MAX_TASKS;
+    options.chain_length = DEFAULT_CHAIN_LENGTH;
+    options.park_usec = DEFAULT_PARK_USEC;
+    options.distribution = false;
+    int only_impl = -1;
+
+    // Parse commandline options
+    int opt;
+    static struct option long_options[] = {
+        {"num_threads",  1, 0, 'n'},
+        {"samples",      1, 0, 's'},
+        {"max_tasks",    1, 0, 'm'},
+        {"chain_length", 1, 0, 'l'},
+        {"park_usec",    1, 0, 'p'},
+        {"impl",         1, 0, 'x'},
+        {"distribution", 0, 0, 'd'},
+        {"help",         0, 0, '?'},
+        {0, 0, 0, 0},
+    };
+
+    while ((opt = getopt_long(argc, argv, "n:s:m:l:p:x:d?", long_options, NULL)) != EOF) {
+
+        switch (opt) {
+        case 'n':
+            options.num_threads = atoi(optarg);
+            break;
+        case 's':
+            options.num_samples = atoi(optarg);
+            break;
+        case 'm':
+            options.max_tasks = atoi(optarg);
+            break;
+        case 'l':
+            options.chain_length = atoi(optarg);
+            break;
+        case 'p':
+            options.park_usec = atoi(optarg);
+            break;
+        case 'x':
+            only_impl = atoi(optarg);
+            break;
+        case 'd':
+            options.distribution = true;
+            break;
+        case '?':
+        default:
+            usage(argv[0], benches, num_benches);
+            return 1;
+        }
+    }
+
+    if (options.num_samples < 1 || options.chain_length < 1 || only_impl >= N_TASKSYS_IMPLS) {
+        fprintf(stderr, "Error: invalid option value!\n");
+        usage(argv[0], benches, num_benches);
+        return 1;
+    }
+
+    // Benchmarks named on the command line, in order
+    std::vector<int> selected;
+    for (int arg = optind; arg < argc; arg++) {
+        int found = -1;
+        for (int b = 0; b < num_benches; b++) {
+            if (std::string(benches[b].name) == argv[arg]) {
+                found = b;
+            }
+        }
+        if (found < 0) {
+            fprintf(stderr, "Error: invalid benchmark %s!\n", argv[arg]);
+            usage(argv[0], benches, num_benches);
+            return 1;
+        }
+        selected.push_back(found);
+    }
+    if (selected.empty()) {
+        for (int b = 0; b < num_benches; b++) {
+            selected.push_back(b);
+        }
+    }
+
+    for (int i = 0; i < N_TASKSYS_IMPLS; i++) {
+        if (only_impl >= 0 && i != only_impl) {
+            continue;
+        }
+        ITaskSystem* t = selectTaskSystemRefImpl(options.num_threads, (TaskSystemType) i);
+        printf("============================================================="
+               "======================\n");
+        printf("Task system: %s (%d threads)\n", t->name(), options.num_threads);
+        printf("============================================================="
+               "======================\n");
+        for (int b : selected) {
+            benches[b].run(t, options);
+        }
+        delete t;
+    }
+    printf("============================================================="
+           "======================\n");
+    return 0;
+}
@@ -0,0 +1,24 @@
+/*
+ * Compiled by the Makefiles to decide whether the OpenMP baseline task
+ * system can be built: it needs OpenMP 5.0 detached tasks and depend
+ * iterators (GCC 11 or later).  The Makefiles only add -fopenmp when
+ * this compiles and links with it.
+ */
+#include <omp.h>
+
+int main() {
+    int done[2] = {0, 0};
+    int deps[1] = {0};
+    int num_deps = 1;
+    omp_event_handle_t event;
+    #pragma omp parallel
+    #pragma omp single
+    {
+        #pragma omp task detach(event) depend(out: done[0])
+        {}
+        omp_fulfill_event(event);
+        #pragma omp task depend(iterator(k = 0 : num_deps), in: done[deps[k]]) depend(out: done[1])
+        {}
+    }
+    return 0;
+}
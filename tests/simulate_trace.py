@@ -0,0 +1,273 @@
+import argparse
+import heapq
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+from analyze_trace import load_trace, add_serial_deps
+
+# 离散事件调度模拟器：用 runtasks --trace 录下的负载 (启动大小、实测任务时长、依赖)
+# 在不同的 worker 数、调度策略和开销模型下重放，不运行真正的任务。
+# --validate 模式运行 runtasks 录制 trace，用录下的 worker 数模拟，报告预测与实测的误差
+
+POLICIES = ["fifo", "critical-path"]
+
+
+class Workload:
+    # use_submit_times: 按录下的提交时间提交启动；同步 run() 的提交时间取决于前一个启动何时完成，
+    # 这时应当忽略，只靠 (串起来的) 依赖决定顺序
+    def __init__(self, launches, use_submit_times=True):
+        self.ids = sorted(launches)
+        # (launch, task) -> 时长 (us)；trace 中缺失的任务用该启动的平均时长
+        self.duration = {}
+        self.num_tasks = {}
+        self.submit = {}
+        # 启动级依赖 (依赖前驱的全部任务) 和任务级窗口依赖
+        self.all_deps = {i: [] for i in self.ids}
+        self.window_deps = {i: [] for i in self.ids}
+        first_submit = min([l.submit for l in launches.values() if l.submit is not None] + [0.0])
+        for i in self.ids:
+            l = launches[i]
+            n = max(l.num_tasks, max(l.task_durations) + 1 if l.task_durations else 0)
+            self.num_tasks[i] = n
+            mean = sum(l.task_durations.values()) / len(l.task_durations) if l.task_durations else 0.0
+            for t in range(n):
+                self.duration[(i, t)] = l.task_durations.get(t, mean)
+            self.submit[i] = (l.submit - first_submit) if l.submit is not None and use_submit_times else 0.0
+            for dep, radius in l.deps:
+                if dep not in launches:
+                    continue
+                if radius < 0:
+                    self.all_deps[i].append(dep)
+                else:
+                    self.window_deps[i].append((dep, radius))
+
+    def work(self):
+        return sum(self.duration.values())
+
+    def bottom_levels(self):
+        # 每个任务到图出口的最长路径 (含自身时长)，critical-path 策略据此排序
+        level = {}
+        all_succ_level = {i: 0.0 for i in self.ids}
+        window_succ = {}
+        for i in self.ids:
+            for dep, radius in self.window_deps[i]:
+                for t in range(self.num_tasks[i]):
+                    for j in range(max(0, t - radius), min(self.num_tasks[dep], t + radius + 1)):
+                        window_succ.setdefault((dep, j), []).append((i, t))
+        all_succ = {i: [] for i in self.ids}
+        for i in self.ids:
+            for dep in self.all_deps[i]:
+                all_succ[dep].append(i)
+        launch_level = {}
+        for i in reversed(self.ids):
+            after = max([launch_level[s] for s in all_succ[i]] + [0.0])
+            all_succ_level[i] = after
+            best = 0.0
+            for t in range(self.num_tasks[i]):
+                succ = max([level[s] for s in window_succ.get((i, t), [])] + [after])
+                level[(i, t)] = self.duration[(i, t)] + succ
+                best = max(best, level[(i, t)])
+            launch_level[i] = best
+        return level
+
+
+def simulate(workload, workers, policy="fifo", chunk=1, claim_overhead=0.0,
+             launch_overhead=0.0, wake_latency=0.0, bottom_levels=None):
+    ids = workload.ids
+    num_tasks = workload.num_tasks
+    # 每个任务尚未满足的依赖数：未完成的启动级前驱 + 未完成的窗口前驱任务
+    pending = {}
+    all_succ = {i: [] for i in ids}
+    window_succ = {}
+    for i in ids:
+        for dep in workload.all_deps[i]:
+            all_succ[dep].append(i)
+        for t in range(num_tasks[i]):
+            pending[(i, t)] = len(workload.all_deps[i])
+        for dep, radius in workload.window_deps[i]:
+            for t in range(num_tasks[i]):
+                for j in range(max(0, t - radius), min(num_tasks[dep], t + radius + 1)):
+                    window_succ.setdefault((dep, j), []).append((i, t))
+                    pending[(i, t)] += 1
+    remaining = dict(num_tasks)
+
+    ready = []
+    events = []
+    seq = [0]
+
+    def push_ready(task):
+        # fifo 按就绪顺序领取，critical-path 优先领取到出口路径最长的任务
+        seq[0] += 1
+        key = -bottom_levels[task] if policy == "critical-path" else 0.0
+        heapq.heappush(ready, (key, seq[0], task))
+
+    # 事件：(时间, 序号, 类型, 数据)
+    def schedule(time, kind, data):
+        seq[0] += 1
+        heapq.heappush(events, (time, seq[0], kind, data))
+
+    submitted = set()
+
+    def release(task, time):
+        # 依赖满足的任务经过 launch_overhead 后才能被领取；提交之前满足的等提交时再放出
+        if task[0] in submitted:
+            schedule(time + launch_overhead, "release", task)
+
+    for i in ids:
+        schedule(workload.submit[i] + launch_overhead, "submit", i)
+
+    idle = workers
+    makespan = 0.0
+    while events:
+        time, _, kind, data = heapq.heappop(events)
+        # 刚完成任务的 worker 直接领取下一个任务，不需要被唤醒
+        hot = 0
+        if kind == "submit":
+            submitted.add(data)
+            if num_tasks[data] == 0:
+                schedule(time, "launch_done", data)
+            for t in range(num_tasks[data]):
+                if pending[(data, t)] == 0:
+                    push_ready((data, t))
+        elif kind == "release":
+            push_ready(data)
+        elif kind == "task_done":
+            idle += 1
+            hot = 1
+            for task in data:
+                for succ in window_succ.get(task, []):
+                    pending[succ] -= 1
+                    if pending[succ] == 0:
+                        release(succ, time)
+                remaining[task[0]] -= 1
+                if remaining[task[0]] == 0:
+                    schedule(time, "launch_done", task[0])
+        elif kind == "launch_done":
+            makespan = max(makespan, time)
+            for s in all_succ[data]:
+                for t in range(num_tasks[s]):
+                    pending[(s, t)] -= 1
+                    if pending[(s, t)] == 0:
+                        release((s, t), time)
+        # 空闲的 worker 领取就绪任务；同一个启动的任务最多 chunk 个一起领取
+        while idle > 0 and ready:
+            claimed = [heapq.heappop(ready)[2]]
+            while len(claimed) < chunk and ready and ready[0][2][0] == claimed[0][0]:
+                claimed.append(heapq.heappop(ready)[2])
+            start = time + claim_overhead + (0.0 if hot > 0 else wake_latency)
+            hot -= 1
+            idle -= 1
+            schedule(start + sum(workload.duration[t] for t in claimed), "task_done", claimed)
+    return makespan
+
+
+def measured_elapsed(launches, spans):
+    begin = min([s[0] for s in spans] + [l.submit for l in launches.values() if l.submit is not None])
+    end = max([s[1] for s in spans] + [l.complete for l in launches.values() if l.complete is not None])
+    return end - begin
+
+
+def run_runtasks(binary, test, num_threads, impl, prefix):
+    # 运行 runtasks 录制 trace，返回 trace 文件和该实现的计时 (ms)
+    cmd = "%s -i 1 -n %d -t %s %s" % (binary, num_threads, prefix, test)
+    output = subprocess.check_output(cmd, shell=True).decode('utf-8')
+    times = [float(m.group(1)) for m in re.finditer(r'\]:\s+\[(\d+\.\d+)\] ms', output)]
+    return "%s_%d.json" % (prefix, impl), times[impl] if impl < len(times) else None
+
+
+def print_table_header():
+    print("  %8s %14s %6s %10s %8s" % ("workers", "policy", "chunk", "ms", "speedup"))
+
+
+if __name__ == '__main__':
+
+    # 设置脚本的功能描述
+    parser = argparse.ArgumentParser(
+        description='Replay a recorded task workload under different worker counts and scheduling policies')
+    parser.add_argument('traces', nargs='*', help='Chrome trace JSON files written by runtasks --trace')
+    parser.add_argument('-w', '--workers', type=int, nargs='+', default=[],
+                        help='Worker counts to simulate (default: the recorded worker count)')
+    parser.add_argument('-p', '--policies', nargs='+', default=["fifo"], choices=POLICIES,
+                        help='Scheduling policies to simulate: %s' % ", ".join(POLICIES))
+    parser.add_argument('-c', '--chunks', type=int, nargs='+', default=[1],
+                        help='Tasks of one launch a worker claims at a time')
+    parser.add_argument('--claim-overhead', type=float, default=0.5,
+                        help='Modelled cost of claiming work, in us (0.5 by default)')
+    parser.add_argument('--launch-overhead', type=float, default=2.0,
+                        help='Modelled cost of submitting or releasing a launch, in us (2 by default)')
+    parser.add_argument('--wake-latency', type=float, default=5.0,
+                        help='Modelled latency of waking an idle worker, in us (5 by default)')
+    parser.add_argument('--serial-launches', action='store_true',
+                        help='Treat each launch as depending on the previous one, as with a single thread calling run()')
+    parser.add_argument('--validate', nargs='+', metavar='TEST',
+                        help='Record each test with runtasks and compare predictions with the measured time')
+    parser.add_argument('--runtasks', default='./runtasks', help='runtasks binary used by --validate')
+    parser.add_argument('-n', '--num_threads', type=int, default=8,
+                        help='Threads of the task system recorded by --validate (8 by default)')
+    parser.add_argument('--impl', type=int, default=3,
+                        help='Index of the task system whose trace --validate replays (3 = thread pool + sleep)')
+    args = parser.parse_args()
+
+    model = dict(claim_overhead=args.claim_overhead, launch_overhead=args.launch_overhead,
+                 wake_latency=args.wake_latency)
+
+    # 预测与实测对比 ------------------------------------------------------------------------------------ start
+    if args.validate:
+        print("%-45s %8s %11s %11s %8s" % ("test", "workers", "measured ms", "predicted ms", "error"))
+        errors = []
+        tmpdir = tempfile.mkdtemp()
+        for test in args.validate:
+            trace_path, measured = run_runtasks(args.runtasks, test, args.num_threads, args.impl,
+                                                os.path.join(tmpdir, test))
+            _, launches, spans = load_trace(trace_path)
+            if not spans:
+                print("%-45s no task events recorded" % test)
+                continue
+            # 同步 run() 的 trace 没有依赖事件，按调用顺序串起来
+            serial = args.serial_launches or not any(l.deps for l in launches.values())
+            if serial:
+                add_serial_deps(launches)
+            workload = Workload(launches, not serial)
+            workers = len(set(s[2] for s in spans))
+            predicted = simulate(workload, workers, **model) / 1000
+            if measured is None:
+                measured = measured_elapsed(launches, spans) / 1000
+            error = (predicted - measured) / measured if measured > 0 else 0.0
+            errors.append(abs(error))
+            print("%-45s %8d %11.3f %11.3f %+7.1f%%" % (test, workers, measured, predicted, 100 * error))
+        if errors:
+            print("mean absolute error: %.1f%%" % (100 * sum(errors) / len(errors)))
+        sys.exit(0)
+    # 预测与实测对比 ------------------------------------------------------------------------------------ end
+
+    if not args.traces:
+        parser.error("no trace files given")
+
+    # 按配置重放 ---------------------------------------------------------------------------------------- start
+    for path in args.traces:
+        label, launches, spans = load_trace(path)
+        if not spans:
+            print("%s: no task events" % path)
+            continue
+        if args.serial_launches:
+            add_serial_deps(launches)
+        workload = Workload(launches, not args.serial_launches)
+        recorded_workers = len(set(s[2] for s in spans))
+        work = workload.work()
+        levels = workload.bottom_levels() if "critical-path" in args.policies else None
+        print("==============================================================="
+              "=================")
+        print("Trace: %s (%s)" % (path, label))
+        print("  recorded: %d workers, %.3f ms; work %.3f ms" % (
+            recorded_workers, measured_elapsed(launches, spans) / 1000, work / 1000))
+        print_table_header()
+        for workers in (args.workers or [recorded_workers]):
+            for policy in args.policies:
+                for chunk in args.chunks:
+                    makespan = simulate(workload, workers, policy, chunk, bottom_levels=levels, **model)
+                    print("  %8d %14s %6d %10.3f %8.2f" % (
+                        workers, policy, chunk, makespan / 1000, work / makespan if makespan > 0 else 0))
+    # 按配置重放 ---------------------------------------------------------------------------------------- end
@@ -0,0 +1,458 @@
+#ifndef _TASKSYSBASELINES_H
+#define _TASKSYSBASELINES_H
+
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "itasksys.h"
+
+/*
+ * Task systems built on off-the-shelf runtimes, run by runtasks and
+ * microbench next to the implementations in tasksys.cpp so they can be
+ * compared in the same harness.  Both support user events; the other
+ * optional ITaskSystem methods keep their default implementations
+ * (task-level deps are treated as ALL, no counters).  The OpenMP one is
+ * only built when the compiler supports OpenMP (the Makefiles pass
+ * -fopenmp when it compiles tests/openmpcheck.cpp).
+ */
+
+#ifdef _OPENMP
+
+/*
+ * OpenMP: run() is a `parallel for schedule(dynamic)`.  Asynchronous
+ * launches run as OpenMP tasks, ordered by depend clauses, that execute
+ * their bulk tasks as a taskloop.  OpenMP tasks can only be created
+ * inside a parallel region, so the first asynchronous launch starts a
+ * dispatcher thread that enters a parallel region of num_threads + 1
+ * threads whenever there are submissions; its single construct creates
+ * the task of each launch as soon as the launch is submitted, and sleeps
+ * while there is none, leaving num_threads threads to run tasks.  sync()
+ * is a taskwait on the dispatcher, after which the region ends so every
+ * thread of the team resets its arena.  A user event is a detached task,
+ * completed by omp_fulfill_event() when it is signaled.
+ */
+class TaskSystemOpenMP: public ITaskSystem {
+    public:
+        TaskSystemOpenMP(int num_threads)
+          : ITaskSystem(num_threads), num_threads_(num_threads), next_id_(0),
+            dispatcher_started_(false), stop_(false), synced_id_(0), first_id_(0) {}
+
+        ~TaskSystemOpenMP() {
+            if (!dispatcher_started_) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(lock_);
+                stop_ = true;
+            }
+            submitted_.notify_one();
+            dispatcher_.join();
+        }
+
+        const char* name() {
+            return "OpenMP";
+        }
+
+        void run(IRunnable* runnable, int num_total_tasks) {
+            #pragma omp parallel num_threads(num_threads_)
+            {
+                #pragma omp for schedule(dynamic)
+                for (int i = 0; i < num_total_tasks; i++) {
+                    runnable->runTask(i, num_total_tasks);
+                }
+                // Past the loop's barrier the launch is complete
+                TaskArena::current()->reset();
+            }
+        }
+
+        TaskID runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
+                                const std::vector<TaskID>& deps) {
+            std::lock_guard<std::mutex> lock(lock_);
+            return submit(runnable, num_total_tasks, deps);
+        }
+
+        TaskID createEvent() {
+            std::lock_guard<std::mutex> lock(lock_);
+            TaskID id = submit(NULL, 0, std::vector<TaskID>());
+            events_[id] = PendingEvent();
+            return id;
+        }
+
+        void signal(TaskID event) {
+            std::lock_guard<std::mutex> lock(lock_);
+            std::map<TaskID, PendingEvent>::iterator it = events_.find(event);
+            if (it == events_.end() || it->second.signaled) {
+                return;
+            }
+            it->second.signaled = true;
+            if (it->second.attached) {
+                omp_fulfill_event(it->second.handle);
+            }
+        }
+
+        void sync() {
+            std::unique_lock<std::mutex> lock(lock_);
+            if (!dispatcher_started_) {
+                return;
+            }
+            TaskID target = next_id_;
+            queue_.push_back(Submission(Submission::SYNC, target, NULL, 0));
+            submitted_.notify_one();
+            synced_.wait(lock, [this, target]() { return synced_id_ >= target; });
+        }
+
+    private:
+        struct Submission {
+            enum Kind { LAUNCH, EVENT, SYNC };
+            Kind kind;
+            // the launch's or event's TaskID, or for SYNC the first
+            // TaskID not covered by the sync
+            TaskID id;
+            IRunnable* runnable;
+            int num_total_tasks;
+            std::vector<TaskID> deps;
+
+            Submission(Kind kind, TaskID id, IRunnable* runnable, int num_total_tasks)
+              : kind(kind), id(id), runnable(runnable), num_total_tasks(num_total_tasks) {}
+        };
+
+        struct PendingEvent {
+            bool signaled;
+            // set once the dispatcher has created the event's detached task
+            bool attached;
+            omp_event_handle_t handle;
+
+            PendingEvent(): signaled(false), attached(false) {}
+        };
+
+        // Called with lock_ held.
+        TaskID submit(IRunnable* runnable, int num_total_tasks, const std::vector<TaskID>& deps) {
+            if (!dispatcher_started_) {
+                dispatcher_started_ = true;
+                dispatcher_ = std::thread([this]() { dispatch(); });
+            }
+            Submission::Kind kind = runnable == NULL ? Submission::EVENT : Submission::LAUNCH;
+            queue_.push_back(Submission(kind, next_id_, runnable, num_total_tasks));
+            queue_.back().deps = deps;
+            submitted_.notify_one();
+            return next_id_++;
+        }
+
+        void dispatch() {
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(lock_);
+                    submitted_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+                    if (queue_.empty()) {
+                        return;
+                    }
+                }
+                TaskID synced = -1;
+                #pragma omp parallel num_threads(num_threads_ + 1)
+                {
+                    #pragma omp single
+                    synced = dispatchUntilSync();
+                    // Past the single's barrier every launch is complete
+                    TaskArena::current()->reset();
+                }
+                if (synced < 0) {
+                    return;
+                }
+                std::lock_guard<std::mutex> lock(lock_);
+                first_id_ = synced;
+                events_.erase(events_.begin(), events_.lower_bound(first_id_));
+                synced_id_ = synced;
+                synced_.notify_all();
+            }
+        }
+
+        // Runs in the single construct: creates the OpenMP task of every
+        // submission, in submission order so the depend clauses see the
+        // earlier launches, until a sync.  Returns the sync's TaskID once
+        // every task created so far is complete, or -1 when stopped.
+        TaskID dispatchUntilSync() {
+            // done[id - first_id_]: only the addresses matter, they name
+            // the launches in the depend clauses.  A deque keeps them
+            // stable as it grows.
+            std::deque<char> done;
+            std::vector<Submission> batch;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(lock_);
+                    submitted_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+                    if (queue_.empty()) {
+                        break;
+                    }
+                    batch.swap(queue_);
+                }
+                for (size_t i = 0; i < batch.size(); i++) {
+                    const Submission& submission = batch[i];
+                    if (submission.kind == Submission::SYNC) {
+                        // Submissions after the sync go to the next region
+                        std::unique_lock<std::mutex> lock(lock_);
+                        queue_.insert(queue_.begin(), batch.begin() + i + 1, batch.end());
+                        lock.unlock();
+                        // Waits for every task created so far, including
+                        // the detached tasks of unsignaled events
+                        #pragma omp taskwait
+                        return submission.id;
+                    }
+                    done.push_back(0);
+                    char* out = &done.back();
+                    // GCC does not count uses in depend clauses
+                    (void)out;
+                    if (submission.kind == Submission::EVENT) {
+                        TaskID event = submission.id;
+                        omp_event_handle_t handle;
+                        #pragma omp task detach(handle) depend(out: out[0])
+                        {
+                            attachEvent(event, handle);
+                        }
+                        continue;
+                    }
+                    // Launches from before the last sync are complete
+                    std::vector<char*> in;
+                    for (TaskID dep : submission.deps) {
+                        if (dep >= first_id_ && dep < submission.id) {
+                            in.push_back(&done[dep - first_id_]);
+                        }
+                    }
+                    char** deps = in.data();
+                    int num_deps = (int)in.size();
+                    IRunnable* runnable = submission.runnable;
+                    int num_total_tasks = submission.num_total_tasks;
+                    (void)deps;
+                    #pragma omp task firstprivate(runnable, num_total_tasks) \
+                        depend(iterator(k = 0 : num_deps), in: deps[k][0]) depend(out: out[0])
+                    {
+                        #pragma omp taskloop grainsize(1)
+                        for (int task_id = 0; task_id < num_total_tasks; task_id++) {
+                            runnable->runTask(task_id, num_total_tasks);
+                        }
+                    }
+                }
+                batch.clear();
+            }
+            #pragma omp taskwait
+            return -1;
+        }
+
+        // Completes the detached task of `event` now if it was signaled
+        // before the dispatcher created it, or leaves it for signal().
+        void attachEvent(TaskID event, omp_event_handle_t handle) {
+            std::lock_guard<std::mutex> lock(lock_);
+            PendingEvent& pending = events_[event];
+            if (pending.signaled) {
+                omp_fulfill_event(handle);
+            } else {
+                pending.handle = handle;
+                pending.attached = true;
+            }
+        }
+
+        int num_threads_;
+        std::mutex lock_;
+        // The members below are protected by lock_.
+        TaskID next_id_;
+        bool dispatcher_started_;
+        bool stop_;
+        // submissions the dispatcher has not taken yet
+        std::vector<Submission> queue_;
+        std::condition_variable submitted_;
+        // every launch and event before synced_id_ is complete
+        TaskID synced_id_;
+        std::condition_variable synced_;
+        // events not yet covered by a sync; signal() may be called from
+        // any thread
+        std::map<TaskID, PendingEvent> events_;
+        std::thread dispatcher_;
+        // first TaskID after the last sync; only used by the dispatcher
+        TaskID first_id_;
+};
+
+#endif
+
+/*
+ * std::async: run() starts num_threads - 1 std::async helpers that, with
+ * the calling thread, claim tasks from a shared counter.  Dependencies
+ * are counted here and std::async only provides the threads: an
+ * asynchronous launch is handed to std::async, which runs its tasks the
+ * same way, once the last launch or event it depends on completes.
+ */
+class TaskSystemStdAsync: public ITaskSystem {
+    public:
+        TaskSystemStdAsync(int num_threads)
+          : ITaskSystem(num_threads), num_threads_(num_threads), next_id_(0),
+            first_id_(0), num_incomplete_(0), reap_threshold_(MIN_REAP_THRESHOLD) {}
+
+        ~TaskSystemStdAsync() {
+            sync();
+        }
+
+        const char* name() {
+            return "std::async";
+        }
+
+        void run(IRunnable* runnable, int num_total_tasks) {
+            runTasks(runnable, num_total_tasks, num_threads_);
+        }
+
+        TaskID runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
+                                const std::vector<TaskID>& deps) {
+            std::lock_guard<std::mutex> lock(lock_);
+            TaskID id = addLaunch(runnable, num_total_tasks);
+            // Launches from before the last sync() are complete
+            for (TaskID dep : deps) {
+                if (dep >= first_id_ && dep < id && !launches_[dep - first_id_].done) {
+                    launches_[dep - first_id_].successors.push_back(id);
+                    launches_[id - first_id_].num_pending_deps++;
+                }
+            }
+            if (launches_[id - first_id_].num_pending_deps == 0) {
+                start(id);
+            }
+            return id;
+        }
+
+        TaskID createEvent() {
+            std::lock_guard<std::mutex> lock(lock_);
+            TaskID id = addLaunch(NULL, 0);
+            // Released by signal() rather than by a dependency
+            launches_[id - first_id_].num_pending_deps = 1;
+            return id;
+        }
+
+        void signal(TaskID event) {
+            std::lock_guard<std::mutex> lock(lock_);
+            if (event < first_id_ || event >= next_id_) {
+                return;
+            }
+            Launch& launch = launches_[event - first_id_];
+            if (launch.runnable != NULL || launch.done) {
+                return;
+            }
+            complete(event);
+        }
+
+        void sync() {
+            std::vector<std::future<void> > finished;
+            {
+                std::unique_lock<std::mutex> lock(lock_);
+                all_done_.wait(lock, [this]() { return num_incomplete_ == 0; });
+                launches_.clear();
+                first_id_ = next_id_;
+                finished.swap(futures_);
+            }
+            // The futures' destructors wait for the threads to return
+        }
+
+    private:
+        struct Launch {
+            // NULL for a user event
+            IRunnable* runnable;
+            int num_total_tasks;
+            int num_pending_deps;
+            bool done;
+            std::vector<TaskID> successors;
+        };
+
+        // The methods below are called with lock_ held.
+
+        TaskID addLaunch(IRunnable* runnable, int num_total_tasks) {
+            Launch launch;
+            launch.runnable = runnable;
+            launch.num_total_tasks = num_total_tasks;
+            launch.num_pending_deps = 0;
+            launch.done = false;
+            launches_.push_back(launch);
+            num_incomplete_++;
+            return next_id_++;
+        }
+
+        void start(TaskID id) {
+            IRunnable* runnable = launches_[id - first_id_].runnable;
+            int num_total_tasks = launches_[id - first_id_].num_total_tasks;
+            int num_threads = num_threads_;
+            reapFinished();
+            futures_.push_back(std::async(std::launch::async, [=]() {
+                runTasks(runnable, num_total_tasks, num_threads);
+                std::lock_guard<std::mutex> lock(lock_);
+                complete(id);
+            }));
+        }
+
+        // A std::async thread is only joined when its future is destroyed,
+        // so the futures of finished launches are dropped as they pile up
+        // rather than at sync(); otherwise a long graph holds one exited
+        // thread per launch.
+        void reapFinished() {
+            if (futures_.size() < reap_threshold_) {
+                return;
+            }
+            futures_.erase(std::remove_if(futures_.begin(), futures_.end(),
+                               [](const std::future<void>& f) {
+                                   return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+                               }),
+                           futures_.end());
+            reap_threshold_ = std::max(MIN_REAP_THRESHOLD, 2 * futures_.size());
+        }
+
+        void complete(TaskID id) {
+            Launch& launch = launches_[id - first_id_];
+            launch.done = true;
+            for (TaskID successor : launch.successors) {
+                if (--launches_[successor - first_id_].num_pending_deps == 0) {
+                    start(successor);
+                }
+            }
+            if (--num_incomplete_ == 0) {
+                all_done_.notify_all();
+            }
+        }
+
+        static void runTasks(IRunnable* runnable, int num_total_tasks, int num_threads) {
+            std::atomic<int> next_task(0);
+            auto worker = [&]() {
+                for (int i = next_task++; i < num_total_tasks; i = next_task++) {
+                    runnable->runTask(i, num_total_tasks);
+                }
+            };
+            std::vector<std::future<void> > helpers;
+            for (int i = 1; i < std::min(num_threads, num_total_tasks); i++) {
+                helpers.push_back(std::async(std::launch::async, worker));
+            }
+            worker();
+            for (std::future<void>& helper : helpers) {
+                helper.get();
+            }
+            // The helpers' arenas go away with their threads
+            TaskArena::current()->reset();
+        }
+
+        int num_threads_;
+        std::mutex lock_;
+        std::condition_variable all_done_;
+        TaskID next_id_;
+        // launches and events since the last sync(), indexed by
+        // TaskID - first_id_
+        TaskID first_id_;
+        std::vector<Launch> launches_;
+        int num_incomplete_;
+        // launches started since the last sync() that may still be running
+        std::vector<std::future<void> > futures_;
+        static const size_t MIN_REAP_THRESHOLD = 64;
+        size_t reap_threshold_;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef _TASKSYSIMPLS_H
+#define _TASKSYSIMPLS_H
+
+#include <assert.h>
+
+#include "tasksys.h"
+#include "tasksysbaselines.h"
+
+/*
+ * The task system implementations runtasks and microbench measure, in
+ * the order they are run.
+ */
+enum TaskSystemType {
+    SERIAL,
+    PARALLEL_SPAWN,
+    PARALLEL_THREAD_POOL_SPINNING,
+    PARALLEL_THREAD_POOL_SLEEPING,
+#ifdef TASKSYS_POLICY_POOLS
+    // Further queue/wait/partition combinations of ThreadPoolTaskSystem;
+    // each needs an explicit instantiation in tasksys.cpp
+    POOL_LOCKFREE_SPIN_DYNAMIC,
+    POOL_LOCKFREE_HYBRID_GUIDED,
+    POOL_WORKSTEALING_SLEEP_STATIC,
+    POOL_WORKSTEALING_HYBRID_GUIDED,
+#endif
+#ifdef _OPENMP
+    PARALLEL_OPENMP,
+#endif
+    PARALLEL_STD_ASYNC,
+    N_TASKSYS_IMPLS, // This must be in the last position.
+};
+
+inline ITaskSystem *selectTaskSystemRefImpl(int num_threads, TaskSystemType type) {
+    assert(type < N_TASKSYS_IMPLS);
+
+    if (type == SERIAL) {
+        return new TaskSystemSerial(num_threads);
+    } else if (type == PARALLEL_SPAWN) {
+        return new TaskSystemParallelSpawn(num_threads);
+    } else if (type == PARALLEL_THREAD_POOL_SPINNING) {
+        return new TaskSystemParallelThreadPoolSpinning(num_threads);
+    } else if (type == PARALLEL_THREAD_POOL_SLEEPING) {
+        return new TaskSystemParallelThreadPoolSleeping(num_threads);
+#ifdef TASKSYS_POLICY_POOLS
+    } else if (type == POOL_LOCKFREE_SPIN_DYNAMIC) {
+        return new ThreadPoolTaskSystem<LockFreeQueue, SpinWait, DynamicPartition>(num_threads);
+    } else if (type == POOL_LOCKFREE_HYBRID_GUIDED) {
+        return new ThreadPoolTaskSystem<LockFreeQueue, HybridWait, GuidedPartition>(num_threads);
+    } else if (type == POOL_WORKSTEALING_SLEEP_STATIC) {
+        return new ThreadPoolTaskSystem<WorkStealingQueue, SleepWait, StaticPartition>(num_threads);
+    } else if (type == POOL_WORKSTEALING_HYBRID_GUIDED) {
+        return new ThreadPoolTaskSystem<WorkStealingQueue, HybridWait, GuidedPartition>(num_threads);
+#endif
+#ifdef _OPENMP
+    } else if (type == PARALLEL_OPENMP) {
+        return new TaskSystemOpenMP(num_threads);
+#endif
+    } else if (type == PARALLEL_STD_ASYNC) {
+        return new TaskSystemStdAsync(num_threads);
+    } else {
+        return NULL;
+    }
+}
+
+#endif
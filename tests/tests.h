@@ -3,12 +3,22 @@
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
 #include <thread>
 #include <atomic>
 #include <set>
+#include <map>
+#include <string>
+#include <vector>
+#include <new>
+#include <random>
+#include <algorithm>
 
 #include "CycleTimer.h"
 #include "itasksys.h"
+#include "pipeline.h"
+#include "allochook.h"
 
 /*
 Sync tests
@@ -37,6 +47,44 @@ TestResults mathOperationsInTightForLoopReductionTreeAsyncTest(ITaskSystem* t);
 TestResults spinBetweenRunCallsAsyncTest(ITaskSystem *t);
 TestResults mandelbrotChunkedAsyncTest(ITaskSystem* t);
 TestResults simpleRunDepsTest(ITaskSystem *t);
+TestResults continuationLatencyThenTest(ITaskSystem* t);
+TestResults continuationLatencySyncTest(ITaskSystem* t);
+TestResults pingPongUnequalTaskDepsTest(ITaskSystem *t);
+TestResults stencilBarrierAsyncTest(ITaskSystem* t);
+TestResults stencilWavefrontAsyncTest(ITaskSystem* t);
+TestResults eventDepsTest(ITaskSystem* t);
+TestResults pipelineTest(ITaskSystem* t);
+TestResults pipelineLaunchPerStageAsyncTest(ITaskSystem* t);
+TestResults scratchBufferArenaTest(ITaskSystem* t);
+TestResults scratchBufferNewTest(ITaskSystem* t);
+TestResults scratchBufferArenaAlignedTest(ITaskSystem* t);
+TestResults scratchBufferArenaAsyncTest(ITaskSystem* t);
+TestResults strictGraphDepsAllocFreeTest(ITaskSystem* t);
+TestResults strictGraphDepsLargeBatch(ITaskSystem* t);
+TestResults strictGraphDepsLargePruned(ITaskSystem* t);
+TestResults concurrentRunTest(ITaskSystem* t);
+TestResults wakeupsPerLaunchTest(ITaskSystem* t);
+TestResults skewedParetoTest(ITaskSystem* t);
+TestResults skewedParetoAsyncTest(ITaskSystem* t);
+TestResults skewedLognormalTest(ITaskSystem* t);
+TestResults skewedLognormalAsyncTest(ITaskSystem* t);
+TestResults skewedBimodalTest(ITaskSystem* t);
+TestResults skewedBimodalAsyncTest(ITaskSystem* t);
+TestResults skewedLastTaskTest(ITaskSystem* t);
+TestResults skewedLastTaskAsyncTest(ITaskSystem* t);
+TestResults streamCopyTest(ITaskSystem* t);
+TestResults streamCopyAsyncTest(ITaskSystem* t);
+TestResults streamScaleTest(ITaskSystem* t);
+TestResults streamScaleAsyncTest(ITaskSystem* t);
+TestResults streamAddTest(ITaskSystem* t);
+TestResults streamAddAsyncTest(ITaskSystem* t);
+TestResults streamTriadTest(ITaskSystem* t);
+TestResults streamTriadAsyncTest(ITaskSystem* t);
+TestResults dagChainTest(ITaskSystem* t);
+TestResults dagFanOutFanInTest(ITaskSystem* t);
+TestResults dagWavefront2DTest(ITaskSystem* t);
+TestResults dagButterflyTest(ITaskSystem* t);
+TestResults dagUnbalancedTreeTest(ITaskSystem* t);
 */
 
 /*
@@ -45,8 +93,118 @@ TestResults simpleRunDepsTest(ITaskSystem *t);
 typedef struct {
     bool passed;
     double time;
+    // bytes the timed region read and wrote, for tests bound by memory
+    // bandwidth (0 for the others)
+    double bytes = 0;
 } TestResults;
 
+/*
+ * Workload parameters: tests read their problem sizes through
+ * WorkloadParams::get(), so the same kernel can be run at other sizes with
+ * `runtasks --param name=value` instead of editing its constants.  A
+ * parameter not given on the command line keeps the test's default.  The
+ * parameters read since the last clearUsed() are recorded, so runtasks
+ * can report the sizes each timing was taken at.
+ *
+ * Every parameter has a valid range, positive by default.  A value given
+ * on the command line outside it (or not an integer, for get()) would
+ * end up in allocation sizes and loop bounds, so runtasks reports it and
+ * exits instead.
+ */
+class WorkloadParams {
+    public:
+        static void set(const std::string& name, double value) {
+            state().values[name] = value;
+        }
+
+        static int get(const char* name, int default_value,
+                       int min_value = 1, int max_value = INT_MAX) {
+            double given = lookup(name, default_value);
+            if (!(given == floor(given) && given >= min_value && given <= max_value)) {
+                fprintf(stderr, "Error: parameter %s=%g must be an integer from %d to %d!\n",
+                        name, given, min_value, max_value);
+                exit(1);
+            }
+            int value = (int)given;
+            markUsed(name, std::to_string(value));
+            return value;
+        }
+
+        static double getDouble(const char* name, double default_value,
+                                double min_value, double max_value = HUGE_VAL) {
+            double value = lookup(name, default_value);
+            if (!(std::isfinite(value) && value >= min_value && value <= max_value)) {
+                fprintf(stderr, "Error: parameter %s=%g must be a number from %g to %g!\n",
+                        name, value, min_value, max_value);
+                exit(1);
+            }
+            char text[32];
+            snprintf(text, sizeof(text), "%g", value);
+            markUsed(name, text);
+            return value;
+        }
+
+        static void clearUsed() {
+            state().used.clear();
+        }
+
+        /*
+          Returns "name=value ..." for the parameters read since the last
+          clearUsed(), in the order they were first read.
+         */
+        static std::string used() {
+            std::string text;
+            for (const std::pair<std::string, std::string>& p : state().used) {
+                text += (text.empty() ? "" : " ") + p.first + "=" + p.second;
+            }
+            return text;
+        }
+
+        /*
+          Returns the parameters given on the command line that no test
+          has read.
+         */
+        static std::vector<std::string> unread() {
+            State& s = state();
+            std::vector<std::string> names;
+            for (const std::pair<const std::string, double>& p : s.values) {
+                if (s.read.count(p.first) == 0) {
+                    names.push_back(p.first);
+                }
+            }
+            return names;
+        }
+
+    private:
+        struct State {
+            std::map<std::string, double> values;
+            std::set<std::string> read;
+            std::vector<std::pair<std::string, std::string> > used;
+        };
+
+        static double lookup(const char* name, double default_value) {
+            State& s = state();
+            s.read.insert(name);
+            std::map<std::string, double>::const_iterator it = s.values.find(name);
+            return it == s.values.end() ? default_value : it->second;
+        }
+
+        static void markUsed(const char* name, const std::string& value) {
+            State& s = state();
+            for (const std::pair<std::string, std::string>& p : s.used) {
+                if (p.first == name) {
+                    return;
+                }
+            }
+            s.used.push_back(std::make_pair(std::string(name), value));
+        }
+
+        static State& state() {
+            static State s;
+            return s;
+        }
+};
+
 /*
  * ==================================================================
  *  Skeleton task definition and test definition. Use this to create
@@ -472,6 +630,13 @@ class StrictDependencyTask: public IRunnable {
             }
         }
 
+        // Allows the same task to be launched again.
+        void reset() {
+            tasks_started_ = 0;
+            tasks_ended_ = 0;
+            satisfied_ = false;
+        }
+
         bool depsMet() {
             for (bool *b : in_flags_) {
                 if (*b == false) {
@@ -488,6 +653,381 @@ class StrictDependencyTask: public IRunnable {
         ~StrictDependencyTask() {}
 };
 
+/*
+ * Each task applies a 3-point averaging stencil to a contiguous chunk of
+ * the input array, writing the result to the output array. Elements
+ * outside the array are treated as 0. Task i reads one element from the
+ * chunks of tasks i-1 and i+1, so chained launches only need task i of
+ * the previous launch's neighbourhood i-1 .. i+1 to be complete.
+ */
+class StencilTask: public IRunnable {
+    public:
+        int num_elements_;
+        int* input_array_;
+        int* output_array_;
+        int iters_;
+        StencilTask(int num_elements, int* input_array, int* output_array, int iters)
+          : num_elements_(num_elements), input_array_(input_array),
+            output_array_(output_array), iters_(iters) {}
+        ~StencilTask() {}
+
+        static inline int stencil(const int* input, int num_elements, int i, int iters) {
+            int left = (i > 0) ? input[i-1] : 0;
+            int right = (i < num_elements - 1) ? input[i+1] : 0;
+            int value = (left + 2 * input[i] + right) / 4;
+            // Proxy for a more expensive per-element computation.
+            for (int j = 0; j < iters; j++) {
+                if (j % 2 == 0)
+                    value++;
+            }
+            return value - (iters + 1) / 2;
+        }
+
+        void runTask(int task_id, int num_total_tasks) {
+            int elements_per_task = (num_elements_ + num_total_tasks-1) / num_total_tasks;
+            int start_el = elements_per_task * task_id;
+            int end_el = std::min(start_el + elements_per_task, num_elements_);
+
+            for (int i=start_el; i<end_el; i++)
+                output_array_[i] = stencil(input_array_, num_elements_, i, iters_);
+        }
+};
+
+/*
+ * Each task scales a contiguous chunk of the input array by `scale_` and
+ * writes it to the output array.
+ */
+class ScaleTask: public IRunnable {
+    public:
+        int num_elements_;
+        const int* input_array_;
+        int* output_array_;
+        int scale_;
+        ScaleTask(int num_elements, const int* input_array, int* output_array, int scale)
+          : num_elements_(num_elements), input_array_(input_array),
+            output_array_(output_array), scale_(scale) {}
+        ~ScaleTask() {}
+
+        void runTask(int task_id, int num_total_tasks) {
+            int elements_per_task = (num_elements_ + num_total_tasks-1) / num_total_tasks;
+            int start_el = elements_per_task * task_id;
+            int end_el = std::min(start_el + elements_per_task, num_elements_);
+
+            for (int i=start_el; i<end_el; i++)
+                output_array_[i] = scale_ * input_array_[i];
+        }
+};
+
+/*
+ * Filters of a three-stage parse -> compute -> reduce pipeline. The parse
+ * stage reads the next input value into a new item, the compute stage does
+ * a CPU-bound amount of work per item, and the reduce stage appends the
+ * results to the output in stream order.
+ */
+struct StreamItem {
+    int value;
+    int result;
+};
+
+static inline int streamCompute(int value, int iters) {
+    unsigned int x = value;
+    for (int i = 0; i < iters; i++) {
+        x = x * 1664525u + 1013904223u;
+    }
+    return (int)(x >> 8);
+}
+
+class StreamParseFilter: public PipelineFilter {
+    public:
+        const int* input_;
+        int num_items_;
+        int next_;
+        StreamParseFilter(const int* input, int num_items)
+          : PipelineFilter(SERIAL_IN_ORDER), input_(input), num_items_(num_items), next_(0) {}
+
+        void* process(void* item) {
+            if (next_ == num_items_) {
+                return nullptr;
+            }
+            StreamItem* s = new StreamItem;
+            s->value = input_[next_++];
+            return s;
+        }
+};
+
+class StreamComputeFilter: public PipelineFilter {
+    public:
+        int iters_;
+        StreamComputeFilter(int iters): PipelineFilter(PARALLEL), iters_(iters) {}
+
+        void* process(void* item) {
+            StreamItem* s = static_cast<StreamItem*>(item);
+            s->result = streamCompute(s->value, iters_);
+            return s;
+        }
+};
+
+class StreamReduceFilter: public PipelineFilter {
+    public:
+        std::vector<int>& output_;
+        StreamReduceFilter(std::vector<int>& output)
+          : PipelineFilter(SERIAL_IN_ORDER), output_(output) {}
+
+        void* process(void* item) {
+            StreamItem* s = static_cast<StreamItem*>(item);
+            output_.push_back(s->result);
+            delete s;
+            return nullptr;
+        }
+};
+
+/*
+ * Runs one stage of the parse -> compute -> reduce pipeline on a single
+ * item as a bulk task launch of one task.
+ */
+class StreamStageTask: public IRunnable {
+    public:
+        PipelineFilter* filter_;
+        void** item_;
+        StreamStageTask(PipelineFilter* filter, void** item): filter_(filter), item_(item) {}
+        ~StreamStageTask() {}
+
+        void runTask(int task_id, int num_total_tasks) {
+            *item_ = filter_->process(*item_);
+        }
+};
+
+/*
+ * Each task needs a temporary buffer of `scratch_size_` ints: it fills the
+ * buffer with values derived from its task id and writes their sum into
+ * output[task_id]. The buffer comes either from the worker's TaskArena or
+ * from new[] / delete[].
+ */
+class ScratchBufferTask: public IRunnable {
+    public:
+        int* output_;
+        int scratch_size_;
+        bool use_arena_;
+        // alignment requested from the arena, 0 for its default
+        size_t alignment_;
+        // number of arena buffers that were not aligned to alignment_
+        std::atomic<int> misaligned_;
+        // largest bytes_in_use of an arena seen right after an allocation
+        std::atomic<size_t> peak_in_use_;
+        ScratchBufferTask(int* output, int scratch_size, bool use_arena, size_t alignment = 0)
+          : output_(output), scratch_size_(scratch_size), use_arena_(use_arena),
+            alignment_(alignment), misaligned_(0), peak_in_use_(0) {}
+        ~ScratchBufferTask() {}
+
+        static inline int expected(int task_id, int scratch_size) {
+            int sum = 0;
+            for (int i = 0; i < scratch_size; i++)
+                sum += (task_id + i) % 7;
+            return sum;
+        }
+
+        void runTask(int task_id, int num_total_tasks) {
+            int* scratch;
+            if (use_arena_ && alignment_ != 0) {
+                scratch = static_cast<int*>(
+                    TaskArena::current()->allocate(scratch_size_ * sizeof(int), alignment_));
+                if (reinterpret_cast<uintptr_t>(scratch) % alignment_ != 0)
+                    misaligned_++;
+            } else if (use_arena_) {
+                scratch = static_cast<int*>(
+                    TaskArena::current()->allocate(scratch_size_ * sizeof(int)));
+            } else {
+                scratch = new int[scratch_size_];
+            }
+            if (use_arena_) {
+                size_t in_use = TaskArena::current()->stats().bytes_in_use;
+                size_t peak = peak_in_use_.load();
+                while (in_use > peak && !peak_in_use_.compare_exchange_weak(peak, in_use)) {}
+            }
+            for (int i = 0; i < scratch_size_; i++)
+                scratch[i] = (task_id + i) % 7;
+            int sum = 0;
+            for (int i = 0; i < scratch_size_; i++)
+                sum += scratch[i];
+            output_[task_id] = sum;
+            if (!use_arena_) {
+                delete [] scratch;
+            }
+        }
+};
+
+/*
+ * Each task runs as many steps of a linear congruential generator as its
+ * entry of `costs` says, so the cost of the tasks of a launch follows
+ * whatever distribution the costs were drawn from.  The state after k
+ * steps can also be computed in O(log k) steps (see jump()), so checking
+ * the results stays cheap however heavy the tail is.
+ */
+class SkewedCostTask: public IRunnable {
+    public:
+        const int* costs_;
+        unsigned int* output_;
+
+        SkewedCostTask(const int* costs, unsigned int* output)
+          : costs_(costs), output_(output) {}
+
+        static const unsigned int MULTIPLIER = 1664525u;
+        static const unsigned int INCREMENT = 1013904223u;
+
+        void runTask(int task_id, int num_total_tasks) {
+            unsigned int x = task_id;
+            for (int i = 0; i < costs_[task_id]; i++) {
+                x = x * MULTIPLIER + INCREMENT;
+            }
+            output_[task_id] = x;
+        }
+
+        // Returns the state after `steps` steps from `x`, composing the
+        // affine step with itself by repeated squaring.
+        static unsigned int jump(unsigned int x, long long steps) {
+            unsigned int mul = MULTIPLIER, add = INCREMENT;
+            while (steps > 0) {
+                if (steps & 1) {
+                    x = x * mul + add;
+                }
+                add = add * mul + add;
+                mul = mul * mul;
+                steps >>= 1;
+            }
+            return x;
+        }
+};
+
+/*
+ * Each task runs one STREAM kernel over its contiguous slice of the
+ * arrays: COPY c = a, SCALE b = s c, ADD c = a + b, TRIAD a = b + s c.
+ * INIT writes the initial values, so the pages of each slice are first
+ * touched by the thread that runs the task.
+ */
+class StreamBandwidthTask: public IRunnable {
+    public:
+        enum Kernel { INIT, COPY, SCALE, ADD, TRIAD };
+
+        static constexpr double SCALAR = 3.0;
+
+        Kernel kernel_;
+        long long num_elements_;
+        double* a_;
+        double* b_;
+        double* c_;
+
+        StreamBandwidthTask(Kernel kernel, long long num_elements, double* a, double* b, double* c)
+          : kernel_(kernel), num_elements_(num_elements), a_(a), b_(b), c_(c) {}
+
+        void runTask(int task_id, int num_total_tasks) {
+            long long per_task = (num_elements_ + num_total_tasks - 1) / num_total_tasks;
+            long long begin = std::min(num_elements_, per_task * task_id);
+            long long end = std::min(num_elements_, begin + per_task);
+            double* a = a_;
+            double* b = b_;
+            double* c = c_;
+            switch (kernel_) {
+            case INIT:
+                for (long long i = begin; i < end; i++) {
+                    a[i] = 1.0;
+                    b[i] = 2.0;
+                    c[i] = 0.5;
+                }
+                break;
+            case COPY:
+                for (long long i = begin; i < end; i++) {
+                    c[i] = a[i];
+                }
+                break;
+            case SCALE:
+                for (long long i = begin; i < end; i++) {
+                    b[i] = SCALAR * c[i];
+                }
+                break;
+            case ADD:
+                for (long long i = begin; i < end; i++) {
+                    c[i] = a[i] + b[i];
+                }
+                break;
+            case TRIAD:
+                for (long long i = begin; i < end; i++) {
+                    a[i] = b[i] + SCALAR * c[i];
+                }
+                break;
+            }
+        }
+};
+
+/*
+ * One node of a generated task graph (see DagShape below).  Like
+ * StrictDependencyTask, the first task to run checks that every
+ * dependency has finished and the last one to finish records whether they
+ * had, but each task does `work_per_task` steps of computation instead of
+ * sleeping, so the cost of a node can be set from the command line.
+ */
+class DagNodeTask: public IRunnable {
+    private:
+        std::vector<bool*> in_flags_;
+        bool *out_flag_;
+        int work_per_task_;
+        std::atomic<int> tasks_started_;
+        std::atomic<int> tasks_ended_;
+        bool satisfied_;
+
+    public:
+        DagNodeTask(const std::vector<bool*>& in_flags, bool *out_flag, int work_per_task)
+          : in_flags_(in_flags), out_flag_(out_flag), work_per_task_(work_per_task),
+            tasks_started_(0), tasks_ended_(0), satisfied_(false) {}
+
+        void runTask(int task_id, int num_total_tasks) {
+            if (tasks_started_++ == 0) {
+                satisfied_ = true;
+                for (bool *b : in_flags_) {
+                    if (*b == false) {
+                        satisfied_ = false;
+                    }
+                }
+            }
+
+            unsigned int x = task_id;
+            for (int i = 0; i < work_per_task_; i++) {
+                x = x * 1664525u + 1013904223u;
+            }
+            volatile unsigned int sink = x;
+            (void)sink;
+
+            if (++tasks_ended_ == num_total_tasks) {
+                *out_flag_ = satisfied_;
+            }
+        }
+};
+
+/*
+ * Each task performs a small fixed amount of work. The last task of the
+ * bulk task launch to finish records the time at which it finished, so
+ * the latency until the launch's completion is observed can be measured.
+ */
+class LastTaskTimestampTask: public IRunnable {
+    public:
+        int *output_;
+        std::atomic<int> tasks_ended_;
+        double last_task_end_time_;
+        LastTaskTimestampTask(int *output)
+          : output_(output), tasks_ended_(0), last_task_end_time_(0) {}
+        ~LastTaskTimestampTask() {}
+
+        void reset() {
+            tasks_ended_ = 0;
+        }
+
+        void runTask(int task_id, int num_total_tasks) {
+            output_[task_id] += task_id;
+            if (++tasks_ended_ == num_total_tasks) {
+                last_task_end_time_ = CycleTimer::currentSeconds();
+            }
+        }
+};
+
 /* 
  * ==================================================================
  *   Begin test definitions
@@ -585,10 +1125,13 @@ TestResults simpleTestAsync(ITaskSystem* t) {
  * and does O(base_iters) work per element.
  */
 TestResults pingPongTest(ITaskSystem* t, bool equal_work, bool do_async,
-                         int num_elements, int base_iters) {
+                         int num_elements, int base_iters,
+                         bool task_level_deps = false) {
 
-    int num_tasks = 64;
-    int num_bulk_task_launches = 400;   
+    int num_tasks = WorkloadParams::get("num_tasks", 64);
+    int num_bulk_task_launches = WorkloadParams::get("num_bulk_task_launches", 400);
+    num_elements = WorkloadParams::get("num_elements", num_elements);
+    base_iters = WorkloadParams::get("base_iters", base_iters, 0);
 
     int* input = new int[num_elements];
     int* output = new int[num_elements];
@@ -618,7 +1161,16 @@ TestResults pingPongTest(ITaskSystem* t, bool equal_work, bool do_async,
     double start_time = CycleTimer::currentSeconds();
     TaskID prev_task_id;
     for (int i=0; i<num_bulk_task_launches; i++) {
-        if (do_async) {
+        if (do_async && task_level_deps) {
+            // Task i only reads and writes the elements of task i of the
+            // previous launch.
+            std::vector<TaskDep> deps;
+            if (i > 0) {
+                deps.push_back(TaskDep::identity(prev_task_id));
+            }
+            prev_task_id = t->runAsyncWithTaskDeps(
+                runnables[i], num_tasks, deps);
+        } else if (do_async) {
             std::vector<TaskID> deps;
             if (i > 0) {
                 deps.push_back(prev_task_id);
@@ -713,6 +1265,12 @@ TestResults pingPongUnequalAsyncTest(ITaskSystem* t) {
     return pingPongTest(t, false, true, num_elements, base_iters);
 }
 
+TestResults pingPongUnequalTaskDepsTest(ITaskSystem* t) {
+    int num_elements = 512 * 1024;
+    int base_iters = 32;
+    return pingPongTest(t, false, true, num_elements, base_iters, true);
+}
+
 /*
  * Computation: The following tests compute Fibonacci numbers using
  * recursion. Since the tasks are compute intensive, the tests show
@@ -720,8 +1278,8 @@ TestResults pingPongUnequalAsyncTest(ITaskSystem* t) {
  */
 TestResults recursiveFibonacciTestBase(ITaskSystem* t, bool do_async) {
 
-    int num_tasks = 256;
-    int num_bulk_task_launches = 30;
+    int num_tasks = WorkloadParams::get("num_tasks", 256);
+    int num_bulk_task_launches = WorkloadParams::get("num_bulk_task_launches", 30);
     int fib_index = 25;
 
     int* task_output = new int[num_tasks];
@@ -785,9 +1343,10 @@ TestResults recursiveFibonacciAsyncTest(ITaskSystem* t) {
 TestResults mathOperationsInTightForLoopTestBase(ITaskSystem* t, int num_tasks,
                                                  bool run_with_dependencies, bool do_async) {
 
-    int num_bulk_task_launches = 2000;
+    num_tasks = WorkloadParams::get("num_tasks", num_tasks);
+    int num_bulk_task_launches = WorkloadParams::get("num_bulk_task_launches", 2000);
 
-    int array_size = 512;
+    int array_size = WorkloadParams::get("array_size", 512);
     float* task_output = new float[num_bulk_task_launches * array_size];
 
     for (int i = 0; i < (num_bulk_task_launches * array_size); i++) {
@@ -877,10 +1436,12 @@ TestResults mathOperationsInTightForLoopFewerTasksAsyncTest(ITaskSystem* t) {
  */
 TestResults mathOperationsInTightForLoopFanInTestBase(ITaskSystem* t, bool do_async) {
 
-    int num_tasks = 64;
+    // The expected sums assume 256 launches, so only the tasks per launch
+    // and the array size are parameters
+    int num_tasks = WorkloadParams::get("num_tasks", 64);
     int num_bulk_task_launches = 256;
 
-    int array_size = 2048;
+    int array_size = WorkloadParams::get("array_size", 2048);
     float* task_output = new float[num_bulk_task_launches*array_size];
     float* final_task_output = new float[array_size];
 
@@ -960,10 +1521,11 @@ TestResults mathOperationsInTightForLoopFanInAsyncTest(ITaskSystem* t) {
  */
 TestResults mathOperationsInTightForLoopReductionTreeTestBase(ITaskSystem* t, bool do_async) {
 
-    int num_tasks = 64;
+    // The tree has a fixed depth of 5, so the number of launches is fixed
+    int num_tasks = WorkloadParams::get("num_tasks", 64);
     int num_bulk_task_launches = 32;
 
-    int array_size = 16384;
+    int array_size = WorkloadParams::get("array_size", 16384);
     float* buffer1 = new float[num_bulk_task_launches*array_size];
     float* buffer2 = new float[(num_bulk_task_launches/2)*array_size];
     float* buffer3 = new float[(num_bulk_task_launches/4)*array_size];
@@ -1179,16 +1741,16 @@ TestResults spinBetweenRunCallsAsyncTest(ITaskSystem *t) {
  */
 TestResults mandelbrotChunkedTestBase(ITaskSystem* t, bool do_async) {
 
-    int num_tasks = 128;
+    int num_tasks = WorkloadParams::get("num_tasks", 128);
     
     MandelbrotTask::MandelArgs ma;
     ma.x0 = -2;
     ma.x1 = 1;
     ma.y0 = -1;
     ma.y1 = 1;
-    ma.width = 1600;
-    ma.height = 1200;
-    ma.max_iterations = 256;
+    ma.width = WorkloadParams::get("width", 1600);
+    ma.height = WorkloadParams::get("height", 1200);
+    ma.max_iterations = WorkloadParams::get("max_iterations", 256);
     ma.output = new int[ma.width * ma.height];
     for (int i = 0; i < (ma.width * ma.height); i++) {
         ma.output[i] = 0;
@@ -1337,10 +1899,15 @@ TestResults strictDiamondDepsTest(ITaskSystem *t) {
  * These tests generates and run a random DAG of n tasks and at most m edges,
  * and make all dependencies are satisfied.
  */
-TestResults strictGraphDepsTestBase(ITaskSystem*t, int n, int m, unsigned int seed) {
+TestResults strictGraphDepsTestBase(ITaskSystem*t, int n, int m, unsigned int seed,
+                                    bool batch = false, int pruning_window = 0) {
     // For repeatability.
     srand(seed);
 
+    if (pruning_window > 0) {
+        t->setDepPruningWindow(pruning_window);
+    }
+
     // Each StrictDependencyTask sets this when it is complete.
     bool *done = new bool[n]();
 
@@ -1374,17 +1941,39 @@ TestResults strictGraphDepsTestBase(ITaskSystem*t, int n, int m, unsigned int se
         tasks.push_back(new StrictDependencyTask(flag_deps[i], done + i));
     }
 
+    // In batch mode the whole graph is described up front and submitted
+    // with a single submitBatch() call, with deps given as batch indices.
+    std::vector<LaunchDesc> descs;
+    if (batch) {
+        descs.resize(n);
+        for (int i = 0; i < n; i++) {
+            descs[i].runnable = tasks[i];
+            descs[i].num_total_tasks = (rand() % 15) + 1;
+            descs[i].batch_deps = idx_deps[i];
+        }
+    }
+
     double start_time = CycleTimer::currentSeconds();
-    for (int i = 0; i < n; i++) {
-        // Populate TaskID deps.
-        for (int idx : idx_deps[i]) {
-            task_deps[i].push_back(task_ids[idx]);
+    if (batch) {
+        t->submitBatch(descs.data(), n, task_ids);
+    } else {
+        for (int i = 0; i < n; i++) {
+            // Populate TaskID deps.
+            for (int idx : idx_deps[i]) {
+                task_deps[i].push_back(task_ids[idx]);
+            }
+            // Launch async and record this task's id.
+            task_ids[i] = t->runAsyncWithDeps(tasks[i], (rand() % 15) + 1, task_deps[i]);
         }
-        // Launch async and record this task's id.
-        task_ids[i] = t->runAsyncWithDeps(tasks[i], (rand() % 15) + 1, task_deps[i]);
     }
     t->sync();
     double end_time = CycleTimer::currentSeconds();
+
+    if (pruning_window > 0) {
+        DepPruningStats stats = t->depPruningStats();
+        printf("[%s]:\t\tdeps kept: %lld, pruned: %lld completed, %lld duplicate, %lld transitive\n",
+               t->name(), stats.kept, stats.completed, stats.duplicate, stats.transitive);
+    }
     
     TestResults result;
     result.passed = done[n-1];
@@ -1403,3 +1992,1105 @@ TestResults strictGraphDepsMedium(ITaskSystem* t) {
 TestResults strictGraphDepsLarge(ITaskSystem* t) {
     return strictGraphDepsTestBase(t,1000,20000,0);
 }
+
+TestResults strictGraphDepsLargeBatch(ITaskSystem* t) {
+    return strictGraphDepsTestBase(t,1000,20000,0,true);
+}
+
+TestResults strictGraphDepsLargePruned(ITaskSystem* t) {
+    return strictGraphDepsTestBase(t,1000,20000,0,false,16);
+}
+
+/*
+ * Submits the strict_graph_deps_large DAG several times on the same task
+ * system and counts heap allocations made during the last submission (by
+ * any thread, including the workers).  The earlier submissions warm up
+ * the task system, so an implementation that recycles its launch records
+ * should make no allocations at all.  In the last warm-up submission
+ * every launch waits on a user event until the whole DAG is submitted, so
+ * all launches are in flight at once and any pools reach their peak size.
+ * The count is checked for task systems whose allocationFreeLaunches()
+ * returns true and only printed for the others.
+ */
+TestResults strictGraphDepsAllocFreeTest(ITaskSystem* t) {
+    int n = 1000;
+    int m = 20000;
+    int num_warmup_rounds = 3;
+    srand(0);
+
+    bool *done = new bool[n]();
+    std::vector<std::vector<int> > idx_deps(n);
+    std::vector<std::vector<bool*> > flag_deps(n);
+    std::vector<std::vector<TaskID> > task_deps(n);
+    std::vector<int> num_tasks(n);
+    TaskID *task_ids = new TaskID[n];
+    std::set<std::pair<int,int> > eset;
+
+    for (int i = 0; i < m; i++) {
+        int s = rand() % n;
+        int t = rand() % n;
+        if (s > t) {
+            std::swap(s,t);
+        }
+        if (s == t || eset.count({s,t})) {
+            continue;
+        }
+        idx_deps[t].push_back(s);
+        flag_deps[t].push_back(done + s);
+        eset.insert({s,t});
+    }
+
+    std::vector<StrictDependencyTask*> tasks;
+    for (int i = 0; i < n; i++) {
+        tasks.push_back(new StrictDependencyTask(flag_deps[i], done + i));
+        task_deps[i].reserve(idx_deps[i].size());
+        num_tasks[i] = (rand() % 15) + 1;
+    }
+
+    bool passed = true;
+    double start_time = 0.0;
+    double end_time = 0.0;
+    for (int round = 0; round <= num_warmup_rounds; round++) {
+        for (int i = 0; i < n; i++) {
+            done[i] = false;
+            tasks[i]->reset();
+        }
+        bool measured = (round == num_warmup_rounds);
+        bool gated = (round == num_warmup_rounds - 1);
+        TaskID gate = gated ? t->createEvent() : -1;
+        if (measured) {
+            g_num_allocations = 0;
+            g_count_allocations = true;
+            start_time = CycleTimer::currentSeconds();
+        }
+        for (int i = 0; i < n; i++) {
+            // task_deps[i] has enough capacity, so this does not allocate.
+            task_deps[i].clear();
+            for (int idx : idx_deps[i]) {
+                task_deps[i].push_back(task_ids[idx]);
+            }
+            // Every other launch depends on a root, so holding back the
+            // roots holds back the whole DAG.
+            if (gated && task_deps[i].empty()) {
+                task_deps[i].push_back(gate);
+            }
+            task_ids[i] = t->runAsyncWithDeps(tasks[i], num_tasks[i], task_deps[i]);
+        }
+        if (gated) {
+            t->signal(gate);
+        }
+        t->sync();
+        if (measured) {
+            end_time = CycleTimer::currentSeconds();
+            g_count_allocations = false;
+        }
+        passed = passed && done[n-1];
+    }
+    printf("[%s]:\t\tsteady-state allocations: %lld\n", t->name(),
+           g_num_allocations.load());
+    if (t->allocationFreeLaunches() && g_num_allocations.load() != 0) {
+        passed = false;
+    }
+
+    TestResults result;
+    result.passed = passed;
+    result.time = end_time - start_time;
+
+    for (int i = 0; i < n; i++) {
+        delete tasks[i];
+    }
+    delete[] task_ids;
+    delete[] done;
+    return result;
+}
+
+/*
+ * Computation: These tests measure the latency between the last task of
+ * a bulk task launch finishing and the application reacting to the
+ * launch's completion. The `then` variant reacts in a continuation
+ * registered with LaunchHandle::then(), the `sync` variant reacts after
+ * the calling thread returns from sync(). The reported time is the mean
+ * latency over all bulk task launches.
+ */
+TestResults continuationLatencyTestBase(ITaskSystem* t, bool use_then) {
+    int num_tasks = 16;
+    int num_bulk_task_launches = 1000;
+
+    int* output = new int[num_tasks];
+    for (int i = 0; i < num_tasks; i++) {
+        output[i] = 0;
+    }
+
+    LastTaskTimestampTask task(output);
+    std::vector<TaskID> no_deps;
+    double total_latency = 0.0;
+    int num_observed = 0;
+
+    for (int i = 0; i < num_bulk_task_launches; i++) {
+        task.reset();
+        if (use_then) {
+            t->launch(&task, num_tasks, no_deps).then([&]() {
+                total_latency += CycleTimer::currentSeconds() - task.last_task_end_time_;
+                num_observed++;
+            });
+            t->sync();
+        } else {
+            t->runAsyncWithDeps(&task, num_tasks, no_deps);
+            t->sync();
+            total_latency += CycleTimer::currentSeconds() - task.last_task_end_time_;
+            num_observed++;
+        }
+    }
+
+    TestResults result;
+    result.passed = (num_observed == num_bulk_task_launches);
+    for (int i = 0; i < num_tasks; i++) {
+        if (output[i] != i * num_bulk_task_launches) {
+            printf("%d: %d expected=%d\n", i, output[i], i * num_bulk_task_launches);
+            result.passed = false;
+            break;
+        }
+    }
+    result.time = total_latency / num_bulk_task_launches;
+
+    delete [] output;
+    return result;
+}
+
+TestResults continuationLatencyThenTest(ITaskSystem* t) {
+    return continuationLatencyTestBase(t, true);
+}
+
+TestResults continuationLatencySyncTest(ITaskSystem* t) {
+    return continuationLatencyTestBase(t, false);
+}
+
+/*
+ * Computation: The following tests ping-pong a 3-point stencil between two
+ * buffers over a chain of bulk task launches. With task-level dependencies,
+ * task i of a launch only waits for tasks i-1 .. i+1 of the previous launch,
+ * so consecutive launches overlap as a wavefront instead of synchronizing
+ * on a barrier between launches.
+ */
+TestResults stencilTestBase(ITaskSystem* t, bool task_level_deps) {
+    int num_tasks = 64;
+    int num_bulk_task_launches = 400;
+    int num_elements = 64 * 1024;
+    int iters = 64;
+
+    int* input = new int[num_elements];
+    int* output = new int[num_elements];
+    int* golden_input = new int[num_elements];
+    int* golden_output = new int[num_elements];
+
+    for (int i=0; i<num_elements; i++) {
+        input[i] = golden_input[i] = (i * 7919) % 1000;
+        output[i] = golden_output[i] = 0;
+    }
+
+    std::vector<StencilTask*> runnables(num_bulk_task_launches);
+    for (int i=0; i<num_bulk_task_launches; i++) {
+        if (i % 2 == 0)
+            runnables[i] = new StencilTask(num_elements, input, output, iters);
+        else
+            runnables[i] = new StencilTask(num_elements, output, input, iters);
+    }
+
+    double start_time = CycleTimer::currentSeconds();
+    TaskID prev_task_id;
+    for (int i=0; i<num_bulk_task_launches; i++) {
+        if (task_level_deps) {
+            std::vector<TaskDep> deps;
+            if (i > 0) {
+                deps.push_back(TaskDep::window(prev_task_id, 1));
+            }
+            prev_task_id = t->runAsyncWithTaskDeps(runnables[i], num_tasks, deps);
+        } else {
+            std::vector<TaskID> deps;
+            if (i > 0) {
+                deps.push_back(prev_task_id);
+            }
+            prev_task_id = t->runAsyncWithDeps(runnables[i], num_tasks, deps);
+        }
+    }
+    t->sync();
+    double end_time = CycleTimer::currentSeconds();
+
+    // Compute the expected result serially
+    for (int j=0; j<num_bulk_task_launches; j++) {
+        for (int i=0; i<num_elements; i++)
+            golden_output[i] = StencilTask::stencil(golden_input, num_elements, i, iters);
+        std::swap(golden_input, golden_output);
+    }
+
+    TestResults results;
+    results.passed = true;
+
+    int* buffer = (num_bulk_task_launches % 2 == 1) ? output : input;
+    for (int i=0; i<num_elements; i++) {
+        if (buffer[i] != golden_input[i]) {
+            results.passed = false;
+            printf("%d: %d expected=%d\n", i, buffer[i], golden_input[i]);
+            break;
+        }
+    }
+    results.time = end_time - start_time;
+
+    delete [] input;
+    delete [] output;
+    delete [] golden_input;
+    delete [] golden_output;
+    for (int i=0; i<num_bulk_task_launches; i++)
+        delete runnables[i];
+
+    return results;
+}
+
+TestResults stencilBarrierAsyncTest(ITaskSystem* t) {
+    return stencilTestBase(t, false);
+}
+
+TestResults stencilWavefrontAsyncTest(ITaskSystem* t) {
+    return stencilTestBase(t, true);
+}
+
+/*
+ * Computation: This test bridges work outside the task system into a
+ * task graph with user events. A producer thread fills one input buffer
+ * at a time, simulating data arriving from I/O, and signals an event for
+ * each buffer. Each consumer bulk task launch depends on the event of its
+ * buffer and on the previous consumer, and is submitted up front, so the
+ * calling thread never blocks until the final sync().
+ */
+TestResults eventDepsTest(ITaskSystem* t) {
+    int num_tasks = 16;
+    int num_buffers = 64;
+    int num_elements = 16 * 1024;
+
+    std::vector<int*> inputs(num_buffers);
+    std::vector<int*> outputs(num_buffers);
+    std::vector<ScaleTask*> runnables(num_buffers);
+    std::vector<TaskID> events(num_buffers);
+    for (int k=0; k<num_buffers; k++) {
+        inputs[k] = new int[num_elements];
+        outputs[k] = new int[num_elements];
+        for (int i=0; i<num_elements; i++) {
+            inputs[k][i] = -1;
+            outputs[k][i] = 0;
+        }
+        runnables[k] = new ScaleTask(num_elements, inputs[k], outputs[k], 2);
+    }
+
+    double start_time = CycleTimer::currentSeconds();
+    for (int k=0; k<num_buffers; k++) {
+        events[k] = t->createEvent();
+    }
+
+    std::thread producer([&]() {
+        for (int k=0; k<num_buffers; k++) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            for (int i=0; i<num_elements; i++) {
+                inputs[k][i] = k + i;
+            }
+            t->signal(events[k]);
+        }
+    });
+
+    TaskID prev_task_id;
+    for (int k=0; k<num_buffers; k++) {
+        std::vector<TaskID> deps;
+        deps.push_back(events[k]);
+        if (k > 0) {
+            deps.push_back(prev_task_id);
+        }
+        prev_task_id = t->runAsyncWithDeps(runnables[k], num_tasks, deps);
+    }
+    t->sync();
+    double end_time = CycleTimer::currentSeconds();
+    producer.join();
+
+    TestResults results;
+    results.passed = true;
+    for (int k=0; k<num_buffers && results.passed; k++) {
+        for (int i=0; i<num_elements; i++) {
+            int expected = 2 * (k + i);
+            if (outputs[k][i] != expected) {
+                results.passed = false;
+                printf("%d/%d: %d expected=%d\n", k, i, outputs[k][i], expected);
+                break;
+            }
+        }
+    }
+    results.time = end_time - start_time;
+
+    for (int k=0; k<num_buffers; k++) {
+        delete [] inputs[k];
+        delete [] outputs[k];
+        delete runnables[k];
+    }
+
+    return results;
+}
+
+/*
+ * Computation: These tests stream items through a parse -> compute ->
+ * reduce pipeline where parse and reduce are serial, in-order stages and
+ * compute is a CPU-bound parallel stage. The `pipeline` variant uses the
+ * Pipeline construct with a bounded number of items in flight. The
+ * `launch_per_stage` variant builds the same flow from runAsyncWithDeps(),
+ * with one bulk task launch per item per stage.
+ */
+TestResults pipelineTestBase(ITaskSystem* t, bool use_pipeline) {
+    int num_items = 20000;
+    int compute_iters = 2000;
+    int max_tokens = 32;
+
+    int* input = new int[num_items];
+    for (int i = 0; i < num_items; i++) {
+        input[i] = i * 31;
+    }
+    std::vector<int> output;
+    output.reserve(num_items);
+
+    StreamParseFilter parse(input, num_items);
+    StreamComputeFilter compute(compute_iters);
+    StreamReduceFilter reduce(output);
+
+    double start_time = CycleTimer::currentSeconds();
+    if (use_pipeline) {
+        Pipeline pipeline;
+        pipeline.addFilter(&parse);
+        pipeline.addFilter(&compute);
+        pipeline.addFilter(&reduce);
+        pipeline.run(t, max_tokens);
+    } else {
+        std::vector<void*> items(num_items, nullptr);
+        std::vector<StreamStageTask> stages;
+        stages.reserve(3 * num_items);
+        TaskID prev_parse = 0, prev_reduce = 0;
+        for (int i = 0; i < num_items; i++) {
+            stages.push_back(StreamStageTask(&parse, &items[i]));
+            stages.push_back(StreamStageTask(&compute, &items[i]));
+            stages.push_back(StreamStageTask(&reduce, &items[i]));
+
+            std::vector<TaskID> deps;
+            if (i > 0) deps.push_back(prev_parse);
+            prev_parse = t->runAsyncWithDeps(&stages[3*i], 1, deps);
+
+            deps.clear();
+            deps.push_back(prev_parse);
+            TaskID compute_id = t->runAsyncWithDeps(&stages[3*i+1], 1, deps);
+
+            deps.clear();
+            deps.push_back(compute_id);
+            if (i > 0) deps.push_back(prev_reduce);
+            prev_reduce = t->runAsyncWithDeps(&stages[3*i+2], 1, deps);
+        }
+        t->sync();
+    }
+    double end_time = CycleTimer::currentSeconds();
+
+    TestResults result;
+    result.passed = ((int)output.size() == num_items);
+    for (int i = 0; i < num_items && result.passed; i++) {
+        int expected = streamCompute(input[i], compute_iters);
+        if (output[i] != expected) {
+            printf("%d: %d expected=%d\n", i, output[i], expected);
+            result.passed = false;
+        }
+    }
+    result.time = end_time - start_time;
+
+    delete [] input;
+    return result;
+}
+
+TestResults pipelineTest(ITaskSystem* t) {
+    return pipelineTestBase(t, true);
+}
+
+TestResults pipelineLaunchPerStageAsyncTest(ITaskSystem* t) {
+    return pipelineTestBase(t, false);
+}
+
+/*
+ * Computation: Every task of these tests allocates a scratch buffer. The
+ * `arena` variant allocates from the worker's TaskArena, the `new` variant
+ * from the global heap. The arena variant also checks that the task system
+ * released all arena memory once the launches completed. The `aligned`
+ * variant asks the arena for cache-line aligned buffers of a size that is
+ * not a multiple of the cache line, and checks every returned pointer. The
+ * `async` variant submits the launches with runAsyncWithDeps() as chains
+ * of four, with a sync() after each chain.
+ *
+ * Every arena variant also checks that the arenas are reset between
+ * launches (or chains): no arena may ever hold more than one launch
+ * (chain) worth of buffers, plus a chunk of slack.
+ */
+TestResults scratchBufferTestBase(ITaskSystem* t, bool use_arena, size_t alignment = 0,
+                                  bool async = false) {
+    int num_tasks = 64;
+    int num_bulk_task_launches = 400;
+    int launches_per_sync = async ? 4 : 1;
+    int scratch_size = alignment ? 4 * 1024 + 3 : 4 * 1024;
+
+    int* output = new int[num_tasks];
+    ScratchBufferTask task(output, scratch_size, use_arena, alignment);
+
+    double start_time = CycleTimer::currentSeconds();
+    for (int i = 0; i < num_bulk_task_launches; i += launches_per_sync) {
+        for (int j = 0; j < num_tasks; j++) {
+            output[j] = 0;
+        }
+        if (async) {
+            // Chained, as the launches all write output
+            std::vector<TaskID> deps;
+            for (int j = 0; j < launches_per_sync; j++) {
+                deps.assign(1, t->runAsyncWithDeps(&task, num_tasks, deps));
+            }
+            t->sync();
+        } else {
+            t->run(&task, num_tasks);
+        }
+    }
+    double end_time = CycleTimer::currentSeconds();
+
+    TestResults result;
+    result.passed = true;
+    for (int i = 0; i < num_tasks; i++) {
+        int expected = ScratchBufferTask::expected(i, scratch_size);
+        if (output[i] != expected) {
+            printf("%d: %d expected=%d\n", i, output[i], expected);
+            result.passed = false;
+            break;
+        }
+    }
+    if (task.misaligned_.load() != 0) {
+        printf("%d arena buffers not aligned to %zu bytes\n", task.misaligned_.load(), alignment);
+        result.passed = false;
+    }
+    size_t max_in_use = (size_t)launches_per_sync * num_tasks * (scratch_size * sizeof(int) + alignment)
+                        + TaskArena::DEFAULT_CHUNK_SIZE;
+    if (use_arena && task.peak_in_use_.load() > max_in_use) {
+        printf("arena not reset between launches: %zu bytes in use, at most %zu expected\n",
+               task.peak_in_use_.load(), max_in_use);
+        result.passed = false;
+    }
+    if (use_arena && t->arenaStats().bytes_in_use != 0) {
+        printf("arena memory still in use after all launches completed: %zu bytes\n",
+               t->arenaStats().bytes_in_use);
+        result.passed = false;
+    }
+    result.time = end_time - start_time;
+
+    delete [] output;
+    return result;
+}
+
+TestResults scratchBufferArenaTest(ITaskSystem* t) {
+    return scratchBufferTestBase(t, true);
+}
+
+TestResults scratchBufferNewTest(ITaskSystem* t) {
+    return scratchBufferTestBase(t, false);
+}
+
+TestResults scratchBufferArenaAlignedTest(ITaskSystem* t) {
+    return scratchBufferTestBase(t, true, 64);
+}
+
+TestResults scratchBufferArenaAsyncTest(ITaskSystem* t) {
+    return scratchBufferTestBase(t, true, 0, true);
+}
+
+/*
+ * Each task adds 1 to its slice of `array`.
+ */
+class SliceIncrementTask : public IRunnable {
+    public:
+        int* array_;
+        int num_elements_;
+
+        SliceIncrementTask(int* array, int num_elements)
+            : array_(array), num_elements_(num_elements) {}
+        ~SliceIncrementTask() {}
+
+        void runTask(int task_id, int num_total_tasks) {
+            int size = (num_elements_ + num_total_tasks - 1) / num_total_tasks;
+            int start = task_id * size;
+            int end = std::min(start + size, num_elements_);
+            for (int i = start; i < end; i++) {
+                array_[i]++;
+            }
+        }
+};
+
+/*
+ * Computation: `num_clients` application threads share one task system and
+ * each call run() `num_runs` times on their own array at the same time, as
+ * the request threads of a server fanning out onto one pool would. Every
+ * launch must be tracked independently: each client's array must end up
+ * incremented exactly `num_runs` times.
+ */
+TestResults concurrentRunTest(ITaskSystem* t) {
+    int num_clients = 16;
+    int num_runs = 200;
+    int num_tasks = 16;
+    int num_elements = 1024;
+
+    std::vector<int*> arrays(num_clients);
+    for (int c = 0; c < num_clients; c++) {
+        arrays[c] = new int[num_elements]();
+    }
+
+    double start_time = CycleTimer::currentSeconds();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < num_clients; c++) {
+        clients.push_back(std::thread([&, c]() {
+            SliceIncrementTask task(arrays[c], num_elements);
+            for (int r = 0; r < num_runs; r++) {
+                t->run(&task, num_tasks);
+            }
+        }));
+    }
+    for (std::thread& client : clients) {
+        client.join();
+    }
+    double end_time = CycleTimer::currentSeconds();
+
+    TestResults result;
+    result.passed = true;
+    for (int c = 0; c < num_clients && result.passed; c++) {
+        for (int i = 0; i < num_elements; i++) {
+            if (arrays[c][i] != num_runs) {
+                printf("client %d, %d: %d expected=%d\n", c, i, arrays[c][i], num_runs);
+                result.passed = false;
+                break;
+            }
+        }
+    }
+    result.time = end_time - start_time;
+
+    for (int c = 0; c < num_clients; c++) {
+        delete [] arrays[c];
+    }
+    return result;
+}
+
+/*
+ * Computation: `num_runs` back-to-back run() calls of only two tasks each.
+ * A pool with many sleeping workers should wake at most as many of them as
+ * there are tasks, so the number of wake-ups per launch reported by
+ * wakeupStats() stays near the task count instead of the thread count.
+ */
+TestResults wakeupsPerLaunchTest(ITaskSystem* t) {
+    int num_runs = 1000;
+    int num_tasks = 2;
+    int num_elements = 64;
+
+    int* array = new int[num_elements]();
+    SliceIncrementTask task(array, num_elements);
+
+    WakeupStats before = t->wakeupStats();
+    double start_time = CycleTimer::currentSeconds();
+    for (int r = 0; r < num_runs; r++) {
+        t->run(&task, num_tasks);
+    }
+    double end_time = CycleTimer::currentSeconds();
+    WakeupStats after = t->wakeupStats();
+
+    long long launches = after.launches - before.launches;
+    long long wakeups = after.wakeups - before.wakeups;
+    long long spurious = after.spurious_wakeups - before.spurious_wakeups;
+    if (launches > 0) {
+        printf("[%s]:\t\twake-ups per launch: %.2f, spurious wake-ups: %lld\n",
+               t->name(), (double)wakeups / launches, spurious);
+    }
+
+    TestResults result;
+    result.passed = true;
+    for (int i = 0; i < num_elements; i++) {
+        if (array[i] != num_runs) {
+            printf("%d: %d expected=%d\n", i, array[i], num_runs);
+            result.passed = false;
+            break;
+        }
+    }
+    result.time = end_time - start_time;
+
+    delete [] array;
+    return result;
+}
+
+/*
+ * Computation: launches whose task costs are drawn from a skewed
+ * distribution with a mean of `mean_cost` generator steps, so a few tasks
+ * take far longer than the rest.  A task system that splits a launch
+ * into equal static ranges of tasks leaves most threads idle while the
+ * unlucky one finishes; one that hands out tasks dynamically does not.
+ *
+ *  - PARETO: heavy power-law tail with shape `pareto_alpha`
+ *  - LOGNORMAL: lognormal with log-standard-deviation `lognormal_sigma`
+ *  - BIMODAL: a `heavy_percent` share of tasks costs `heavy_factor`
+ *    times more than the others
+ *  - LAST_TASK: every task is light except the last one of each launch,
+ *    which costs `heavy_factor` times more; the worst case for a
+ *    scheduler that hands out tasks in order
+ *
+ * Costs are capped at 1000 times the mean.  The async versions submit
+ * the launches without dependencies, so a task system can run tasks of
+ * later launches next to a straggler.
+ */
+enum SkewedCostDistribution {
+    PARETO,
+    LOGNORMAL,
+    BIMODAL,
+    LAST_TASK,
+};
+
+TestResults skewedCostTestBase(ITaskSystem* t, SkewedCostDistribution distribution, bool do_async) {
+
+    int num_tasks = WorkloadParams::get("num_tasks", 1024);
+    int num_bulk_task_launches = WorkloadParams::get("num_bulk_task_launches", 20);
+    double mean_cost = WorkloadParams::get("mean_cost", 5000);
+    std::mt19937 rng(WorkloadParams::get("seed", 1, 0));
+
+    // Draw the cost of every task of every launch, scaled so the mean is
+    // mean_cost (before capping)
+    std::vector<int> costs(num_bulk_task_launches * num_tasks);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    double alpha = 0, sigma = 0, heavy_share = 0, heavy_factor = 0;
+    if (distribution == PARETO) {
+        alpha = WorkloadParams::getDouble("pareto_alpha", 1.5, 0.1);
+    } else if (distribution == LOGNORMAL) {
+        sigma = WorkloadParams::getDouble("lognormal_sigma", 1.5, 0);
+    } else {
+        heavy_factor = WorkloadParams::getDouble("heavy_factor", distribution == BIMODAL ? 50 : 200, 1);
+        if (distribution == BIMODAL) {
+            heavy_share = WorkloadParams::getDouble("heavy_percent", 5, 0, 100) / 100;
+        }
+    }
+    std::lognormal_distribution<double> lognormal(log(mean_cost) - sigma * sigma / 2, sigma);
+    for (int i = 0; i < num_bulk_task_launches; i++) {
+        for (int j = 0; j < num_tasks; j++) {
+            double cost;
+            if (distribution == PARETO) {
+                // inverse CDF; the mean of Pareto(x_m, alpha) is alpha x_m / (alpha - 1)
+                double x_m = alpha > 1 ? mean_cost * (alpha - 1) / alpha : mean_cost;
+                cost = x_m / pow(1.0 - uniform(rng), 1.0 / alpha);
+            } else if (distribution == LOGNORMAL) {
+                cost = lognormal(rng);
+            } else if (distribution == BIMODAL) {
+                double light = mean_cost / (1 - heavy_share + heavy_share * heavy_factor);
+                cost = uniform(rng) < heavy_share ? light * heavy_factor : light;
+            } else {
+                cost = j == num_tasks - 1 ? mean_cost * heavy_factor : mean_cost;
+            }
+            // cap in double: 1000 * mean_cost alone may not fit in an int
+            costs[i * num_tasks + j] = (int)std::min(std::min(cost, 1000 * mean_cost), (double)INT_MAX);
+        }
+    }
+
+    unsigned int* output = new unsigned int[num_bulk_task_launches * num_tasks];
+    std::vector<SkewedCostTask*> runnables(num_bulk_task_launches);
+    for (int i = 0; i < num_bulk_task_launches; i++) {
+        runnables[i] = new SkewedCostTask(&costs[i * num_tasks], &output[i * num_tasks]);
+    }
+
+    double start_time = CycleTimer::currentSeconds();
+    if (do_async) {
+        std::vector<TaskID> no_deps;
+        for (int i = 0; i < num_bulk_task_launches; i++) {
+            t->runAsyncWithDeps(runnables[i], num_tasks, no_deps);
+        }
+        t->sync();
+    } else {
+        for (int i = 0; i < num_bulk_task_launches; i++) {
+            t->run(runnables[i], num_tasks);
+        }
+    }
+    double end_time = CycleTimer::currentSeconds();
+
+    TestResults result;
+    result.passed = true;
+    for (int i = 0; i < num_bulk_task_launches * num_tasks; i++) {
+        unsigned int expected = SkewedCostTask::jump(i % num_tasks, costs[i]);
+        if (output[i] != expected) {
+            printf("%d: %u expected=%u\n", i, output[i], expected);
+            result.passed = false;
+            break;
+        }
+    }
+    result.time = end_time - start_time;
+
+    delete [] output;
+    for (int i = 0; i < num_bulk_task_launches; i++) {
+        delete runnables[i];
+    }
+    return result;
+}
+
+TestResults skewedParetoTest(ITaskSystem* t) {
+    return skewedCostTestBase(t, PARETO, false);
+}
+
+TestResults skewedParetoAsyncTest(ITaskSystem* t) {
+    return skewedCostTestBase(t, PARETO, true);
+}
+
+TestResults skewedLognormalTest(ITaskSystem* t) {
+    return skewedCostTestBase(t, LOGNORMAL, false);
+}
+
+TestResults skewedLognormalAsyncTest(ITaskSystem* t) {
+    return skewedCostTestBase(t, LOGNORMAL, true);
+}
+
+TestResults skewedBimodalTest(ITaskSystem* t) {
+    return skewedCostTestBase(t, BIMODAL, false);
+}
+
+TestResults skewedBimodalAsyncTest(ITaskSystem* t) {
+    return skewedCostTestBase(t, BIMODAL, true);
+}
+
+TestResults skewedLastTaskTest(ITaskSystem* t) {
+    return skewedCostTestBase(t, LAST_TASK, false);
+}
+
+TestResults skewedLastTaskAsyncTest(ITaskSystem* t) {
+    return skewedCostTestBase(t, LAST_TASK, true);
+}
+
+/*
+ * Computation: the STREAM memory-bandwidth kernels, repeated
+ * `num_bulk_task_launches` times over arrays of `array_size` doubles
+ * (128 MiB each by default, larger than the last-level cache), each
+ * launch split into `num_tasks` contiguous slices.  The tests are bound by
+ * memory bandwidth rather than computation, so they show how many threads
+ * saturate DRAM and whether a task system keeps each slice on the thread
+ * that first touched its pages.  With `parallel_init` set (the default)
+ * the arrays are initialized by the task system; with it cleared, by the
+ * calling thread.  The async versions make task i of each launch depend
+ * on task i of the previous one, so launches can overlap.  runtasks
+ * reports the bandwidth from the bytes read and written (STREAM counts:
+ * 16 per element for copy and scale, 24 for add and triad).
+ */
+TestResults streamBandwidthTestBase(ITaskSystem* t, StreamBandwidthTask::Kernel kernel, bool do_async) {
+
+    long long num_elements = WorkloadParams::get("array_size", 1 << 24);
+    int num_tasks = WorkloadParams::get("num_tasks", 64);
+    int num_bulk_task_launches = WorkloadParams::get("num_bulk_task_launches", 10);
+    bool parallel_init = WorkloadParams::get("parallel_init", 1, 0, 1) != 0;
+
+    // new[] does not touch the pages; the init launch does
+    double* a = new double[num_elements];
+    double* b = new double[num_elements];
+    double* c = new double[num_elements];
+    StreamBandwidthTask init(StreamBandwidthTask::INIT, num_elements, a, b, c);
+    if (parallel_init) {
+        t->run(&init, num_tasks);
+    } else {
+        init.runTask(0, 1);
+    }
+
+    StreamBandwidthTask task(kernel, num_elements, a, b, c);
+    double start_time = CycleTimer::currentSeconds();
+    if (do_async) {
+        TaskID prev_task_id = -1;
+        for (int i = 0; i < num_bulk_task_launches; i++) {
+            std::vector<TaskDep> deps;
+            if (i > 0) {
+                deps.push_back(TaskDep::identity(prev_task_id));
+            }
+            prev_task_id = t->runAsyncWithTaskDeps(&task, num_tasks, deps);
+        }
+        t->sync();
+    } else {
+        for (int i = 0; i < num_bulk_task_launches; i++) {
+            t->run(&task, num_tasks);
+        }
+    }
+    double end_time = CycleTimer::currentSeconds();
+
+    // Every kernel leaves its inputs unchanged, so repeating it gives the
+    // same output
+    const double* output = c;
+    double expected = 0;
+    double bytes_per_element = 24;
+    if (kernel == StreamBandwidthTask::COPY) {
+        expected = 1.0;
+        bytes_per_element = 16;
+    } else if (kernel == StreamBandwidthTask::SCALE) {
+        output = b;
+        expected = StreamBandwidthTask::SCALAR * 0.5;
+        bytes_per_element = 16;
+    } else if (kernel == StreamBandwidthTask::ADD) {
+        expected = 3.0;
+    } else {
+        output = a;
+        expected = 2.0 + StreamBandwidthTask::SCALAR * 0.5;
+    }
+
+    TestResults result;
+    result.passed = true;
+    for (long long i = 0; i < num_elements; i++) {
+        if (output[i] != expected) {
+            printf("%lld: %f expected=%f\n", i, output[i], expected);
+            result.passed = false;
+            break;
+        }
+    }
+    result.time = end_time - start_time;
+    result.bytes = bytes_per_element * num_elements * num_bulk_task_launches;
+
+    delete [] a;
+    delete [] b;
+    delete [] c;
+    return result;
+}
+
+TestResults streamCopyTest(ITaskSystem* t) {
+    return streamBandwidthTestBase(t, StreamBandwidthTask::COPY, false);
+}
+
+TestResults streamCopyAsyncTest(ITaskSystem* t) {
+    return streamBandwidthTestBase(t, StreamBandwidthTask::COPY, true);
+}
+
+TestResults streamScaleTest(ITaskSystem* t) {
+    return streamBandwidthTestBase(t, StreamBandwidthTask::SCALE, false);
+}
+
+TestResults streamScaleAsyncTest(ITaskSystem* t) {
+    return streamBandwidthTestBase(t, StreamBandwidthTask::SCALE, true);
+}
+
+TestResults streamAddTest(ITaskSystem* t) {
+    return streamBandwidthTestBase(t, StreamBandwidthTask::ADD, false);
+}
+
+TestResults streamAddAsyncTest(ITaskSystem* t) {
+    return streamBandwidthTestBase(t, StreamBandwidthTask::ADD, true);
+}
+
+TestResults streamTriadTest(ITaskSystem* t) {
+    return streamBandwidthTestBase(t, StreamBandwidthTask::TRIAD, false);
+}
+
+TestResults streamTriadAsyncTest(ITaskSystem* t) {
+    return streamBandwidthTestBase(t, StreamBandwidthTask::TRIAD, true);
+}
+
+/*
+ * A task graph to launch with runAsyncWithDeps(): node i is a launch of
+ * num_tasks[i] tasks that depends on the nodes listed in deps[i], all of
+ * which come before it, so launching the nodes in index order is valid.
+ */
+struct DagShape {
+    std::vector<int> num_tasks;
+    std::vector<std::vector<int> > deps;
+
+    int addNode(int tasks, const std::vector<int>& node_deps) {
+        num_tasks.push_back(tasks);
+        deps.push_back(node_deps);
+        return (int)num_tasks.size() - 1;
+    }
+};
+
+/*
+ * A chain of `length` nodes, each depending on the one before.  Nothing
+ * can overlap, so the time is the latency from one launch completing to
+ * the next one starting, times the length.
+ */
+DagShape makeChainDag(int length, int tasks_per_node) {
+    DagShape dag;
+    for (int i = 0; i < length; i++) {
+        std::vector<int> deps;
+        if (i > 0) {
+            deps.push_back(i - 1);
+        }
+        dag.addNode(tasks_per_node, deps);
+    }
+    return dag;
+}
+
+/*
+ * `stages` rounds of a single node fanning out to `width` independent
+ * nodes that all fan back in to the next single node.  Stresses releasing
+ * many successors at once and counting down a node with many
+ * dependencies.
+ */
+DagShape makeFanOutFanInDag(int width, int stages, int tasks_per_node) {
+    DagShape dag;
+    int join = dag.addNode(tasks_per_node, std::vector<int>());
+    for (int s = 0; s < stages; s++) {
+        std::vector<int> fan;
+        for (int i = 0; i < width; i++) {
+            fan.push_back(dag.addNode(tasks_per_node, std::vector<int>(1, join)));
+        }
+        join = dag.addNode(tasks_per_node, fan);
+    }
+    return dag;
+}
+
+/*
+ * A `size` x `size` grid where node (i, j) depends on (i-1, j) and
+ * (i, j-1), as in a Gauss-Seidel sweep.  The parallelism grows along the
+ * anti-diagonals up to `size` and shrinks again, so the scheduler must
+ * keep up with a ready set that changes width every step.
+ */
+DagShape makeWavefront2DDag(int size, int tasks_per_node) {
+    DagShape dag;
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            std::vector<int> deps;
+            if (i > 0) {
+                deps.push_back((i - 1) * size + j);
+            }
+            if (j > 0) {
+                deps.push_back(i * size + j - 1);
+            }
+            dag.addNode(tasks_per_node, deps);
+        }
+    }
+    return dag;
+}
+
+/*
+ * The butterfly network of a radix-2 FFT over 2^log_width points: a first
+ * row of 2^log_width independent nodes, then log_width rows where node i
+ * depends on nodes i and i ^ 2^(s-1) of the row before.  Every row is as
+ * wide as the first, but the two dependencies of a node are further apart
+ * in each row, so there is no locality for the scheduler to exploit.
+ */
+DagShape makeButterflyDag(int log_width, int tasks_per_node) {
+    DagShape dag;
+    int width = 1 << log_width;
+    for (int i = 0; i < width; i++) {
+        dag.addNode(tasks_per_node, std::vector<int>());
+    }
+    for (int s = 1; s <= log_width; s++) {
+        int prev_row = (s - 1) * width;
+        for (int i = 0; i < width; i++) {
+            std::vector<int> deps;
+            deps.push_back(prev_row + i);
+            deps.push_back(prev_row + (i ^ (1 << (s - 1))));
+            dag.addNode(tasks_per_node, deps);
+        }
+    }
+    return dag;
+}
+
+/*
+ * A reduction over a random tree of `num_nodes` nodes: every node depends
+ * on its children, and the root is the last node launched.  Node k > 0
+ * picks its parent among nodes 0 .. k-1 at k * u^(1/skew) for u uniform in
+ * [0, 1), so a `skew` of 1 gives a random recursive tree, larger values
+ * pick recent parents and grow long chains next to bushy subtrees, and
+ * smaller values give a wide, shallow tree.
+ */
+DagShape makeUnbalancedTreeDag(int num_nodes, double skew, unsigned int seed, int tasks_per_node) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    // Generated top down (parents before children) and launched bottom up
+    std::vector<std::vector<int> > children(num_nodes);
+    for (int k = 1; k < num_nodes; k++) {
+        int parent = std::min(k - 1, (int)(k * pow(uniform(rng), 1.0 / skew)));
+        children[parent].push_back(k);
+    }
+    DagShape dag;
+    for (int k = num_nodes - 1; k >= 0; k--) {
+        std::vector<int> deps;
+        for (int child : children[k]) {
+            deps.push_back(num_nodes - 1 - child);
+        }
+        dag.addNode(tasks_per_node, deps);
+    }
+    return dag;
+}
+
+/*
+ * Launches every node of `dag` with runAsyncWithDeps() and checks that
+ * each one ran after all of its dependencies.  Every node is a launch of
+ * `tasks_per_node` tasks doing `work_per_task` steps each (parameters
+ * read by the callers), so the same shape can be made latency or
+ * throughput bound.
+ */
+TestResults dagShapeTestBase(ITaskSystem* t, const DagShape& dag) {
+    int num_nodes = (int)dag.num_tasks.size();
+    int work_per_task = WorkloadParams::get("work_per_task", 1000);
+
+    bool *done = new bool[num_nodes]();
+    std::vector<DagNodeTask*> tasks;
+    for (int i = 0; i < num_nodes; i++) {
+        std::vector<bool*> flags;
+        for (int dep : dag.deps[i]) {
+            flags.push_back(done + dep);
+        }
+        tasks.push_back(new DagNodeTask(flags, done + i, work_per_task));
+    }
+    std::vector<TaskID> task_ids(num_nodes);
+    std::vector<TaskID> task_deps;
+
+    double start_time = CycleTimer::currentSeconds();
+    for (int i = 0; i < num_nodes; i++) {
+        task_deps.clear();
+        for (int dep : dag.deps[i]) {
+            task_deps.push_back(task_ids[dep]);
+        }
+        task_ids[i] = t->runAsyncWithDeps(tasks[i], dag.num_tasks[i], task_deps);
+    }
+    t->sync();
+    double end_time = CycleTimer::currentSeconds();
+
+    TestResults result;
+    result.passed = true;
+    for (int i = 0; i < num_nodes; i++) {
+        if (!done[i]) {
+            printf("node %d of %d did not run after its dependencies\n", i, num_nodes);
+            result.passed = false;
+            break;
+        }
+    }
+    result.time = end_time - start_time;
+
+    for (DagNodeTask* task : tasks) {
+        delete task;
+    }
+    delete[] done;
+    return result;
+}
+
+TestResults dagChainTest(ITaskSystem* t) {
+    int length = WorkloadParams::get("chain_length", 2000);
+    int tasks_per_node = WorkloadParams::get("tasks_per_node", 1);
+    return dagShapeTestBase(t, makeChainDag(length, tasks_per_node));
+}
+
+TestResults dagFanOutFanInTest(ITaskSystem* t) {
+    int width = WorkloadParams::get("fan_width", 256);
+    int stages = WorkloadParams::get("fan_stages", 8);
+    int tasks_per_node = WorkloadParams::get("tasks_per_node", 4);
+    return dagShapeTestBase(t, makeFanOutFanInDag(width, stages, tasks_per_node));
+}
+
+TestResults dagWavefront2DTest(ITaskSystem* t) {
+    int size = WorkloadParams::get("grid_size", 48);
+    int tasks_per_node = WorkloadParams::get("tasks_per_node", 4);
+    return dagShapeTestBase(t, makeWavefront2DDag(size, tasks_per_node));
+}
+
+TestResults dagButterflyTest(ITaskSystem* t) {
+    int log_width = WorkloadParams::get("log_width", 8, 1, 20);
+    int tasks_per_node = WorkloadParams::get("tasks_per_node", 4);
+    return dagShapeTestBase(t, makeButterflyDag(log_width, tasks_per_node));
+}
+
+TestResults dagUnbalancedTreeTest(ITaskSystem* t) {
+    int num_nodes = WorkloadParams::get("tree_nodes", 2048);
+    double skew = WorkloadParams::getDouble("tree_skew", 4.0, 0.1);
+    unsigned int seed = WorkloadParams::get("seed", 1, 0);
+    int tasks_per_node = WorkloadParams::get("tasks_per_node", 4);
+    return dagShapeTestBase(t, makeUnbalancedTreeDag(num_nodes, skew, seed, tasks_per_node));
+}